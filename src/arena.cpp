@@ -32,6 +32,14 @@ Result<void*, MemoryError> arena_allocator_func(
 
 	} break;
 
+	case M::AllocNonZeroed:{
+		res.value = arena->alloc_non_zeroed(size, align);
+		[[unlikely]] if(!res.value) {
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+
 	case M::Resize: {
 		res.value = arena->resize_in_place(old_ptr, size);
 		[[unlikely]]
@@ -76,6 +84,8 @@ Arena Arena::from_buffer(Slice<u8> buf){
 		.reserved = buf.len(),
 		.commited = buf.len(),
 		.pointer = buf.raw_data(),
+		.commit_chunk = 0,
+		.flags = 0,
 	};
 
 	Arena a = {
@@ -83,6 +93,11 @@ Arena Arena::from_buffer(Slice<u8> buf){
 		.offset = 0,
 		.last_allocation = 0,
 		.type = ArenaType::Buffer,
+		.dirty = buf.len(),
+		.free_blocks = nullptr,
+		.free_block_count = 0,
+		.max_free_blocks = 0,
+		.block_size = 0,
 	};
 
 	return a;
@@ -96,11 +111,110 @@ Arena Arena::make_virtual(isize reserve){
 		.offset = 0,
 		.last_allocation = 0,
 		.type = ArenaType::Virtual,
+		.dirty = 0,
+		.free_blocks = nullptr,
+		.free_block_count = 0,
+		.max_free_blocks = 0,
+		.block_size = 0,
+	};
+
+	return a;
+}
+
+static
+ArenaBlock* arena_block_make(isize reserve){
+	auto data = PageBlock::make(reserve);
+	if(data.reserved == 0){
+		return nullptr;
+	}
+	if(data.push(sizeof(ArenaBlock)) == nullptr){
+		data.destroy();
+		return nullptr;
+	}
+
+	auto blk = (ArenaBlock*)data.pointer;
+	blk->data = data;
+	blk->dirty = sizeof(ArenaBlock);
+	blk->prev = nullptr;
+	return blk;
+}
+
+Arena Arena::make_chained(isize block_size, isize max_free_blocks){
+	Arena a = {
+		.data = {},
+		.offset = 0,
+		.last_allocation = 0,
+		.type = ArenaType::Chained,
+		.dirty = 0,
+		.free_blocks = nullptr,
+		.free_block_count = 0,
+		.max_free_blocks = max_free_blocks,
+		.block_size = block_size,
 	};
 
+	ArenaBlock* blk = arena_block_make(block_size);
+	if(blk != nullptr){
+		a.data = blk->data;
+		a.offset = sizeof(ArenaBlock);
+		a.dirty = blk->dirty;
+	}
 	return a;
 }
 
+// Give a block that is no longer in use back to the arena's free list, or to
+// the OS if enough blocks are already being kept around.
+static
+void arena_chain_retire(Arena* a, ArenaBlock* blk){
+	if(a->free_block_count < a->max_free_blocks){
+		blk->prev = a->free_blocks;
+		a->free_blocks = blk;
+		a->free_block_count += 1;
+	}
+	else {
+		PageBlock data = blk->data;
+		data.destroy();
+	}
+}
+
+// Make a block that fits at least `nbytes` the current block, reusing a
+// retained block if there is one big enough.
+static
+bool arena_chain_grow(Arena* a, isize nbytes){
+	isize needed = nbytes + isize(sizeof(ArenaBlock));
+	ArenaBlock* blk = nullptr;
+
+	ArenaBlock** link = &a->free_blocks;
+	for(ArenaBlock* it = a->free_blocks; it != nullptr; it = it->prev){
+		if(it->data.reserved >= needed){
+			*link = it->prev;
+			a->free_block_count -= 1;
+			blk = it;
+			break;
+		}
+		link = &it->prev;
+	}
+
+	if(blk == nullptr){
+		blk = arena_block_make(max(a->block_size, needed));
+		if(blk == nullptr){
+			return false;
+		}
+	}
+
+	auto current = (ArenaBlock*)a->data.pointer;
+	if(current != nullptr){
+		current->data = a->data;
+		current->dirty = a->dirty;
+	}
+	blk->prev = current;
+
+	a->data = blk->data;
+	a->dirty = blk->dirty;
+	a->offset = sizeof(ArenaBlock);
+	a->last_allocation = 0;
+	return true;
+}
+
 static
 uintptr arena_required_mem(uintptr cur, isize count, isize align){
 	ensure(mem_valid_alignment(align), "Alignment must be a power of 2");
@@ -110,10 +224,13 @@ uintptr arena_required_mem(uintptr cur, isize count, isize align){
 	return required;
 }
 
-void* Arena::alloc(isize size, isize align){
+// Bump the offset without touching the allocated memory or the dirty mark
+static
+void* arena_bump(Arena* arena, isize size, isize align){
+	PageBlock& data = arena->data;
 retry:
 	uintptr base = (uintptr)data.pointer;
-	uintptr current = (uintptr)base + (uintptr)offset;
+	uintptr current = (uintptr)base + (uintptr)arena->offset;
 
 	isize available = data.commited - (current - base);
 	isize required  = arena_required_mem(current, size, align);
@@ -122,20 +239,45 @@ retry:
 		isize in_reserve = data.reserved - data.commited;
 		isize diff = required - available;
 		if(diff > in_reserve){
+			if(arena->type == ArenaType::Chained && arena_chain_grow(arena, size + align)){
+				goto retry;
+			}
 			return nullptr; /* Out of memory */
 		}
-		else if(type == ArenaType::Virtual){
-			if(data.push(required) == nullptr){
+		else if(arena->type != ArenaType::Buffer){
+			if(data.push(diff) == nullptr){
 				return nullptr; /* Out of memory */
 			}
 			goto retry;
 		}
 	}
 
-	offset += required;
-	void* allocation = (u8*)data.pointer + (offset - size);
-	last_allocation = (uintptr)allocation;
-	mem_set(allocation, 0, size);
+	arena->offset += required;
+	void* allocation = (u8*)data.pointer + (arena->offset - size);
+	arena->last_allocation = (uintptr)allocation;
+	return allocation;
+}
+
+void* Arena::alloc(isize size, isize align){
+	void* allocation = arena_bump(this, size, align);
+	[[unlikely]] if(allocation == nullptr){
+		return nullptr;
+	}
+
+	// Anything past the dirty mark is freshly committed and already zeroed
+	isize start = offset - size;
+	isize to_clear = clamp<isize>(0, dirty - start, size);
+	mem_set(allocation, 0, to_clear);
+	dirty = max(dirty, offset);
+	return allocation;
+}
+
+void* Arena::alloc_non_zeroed(isize size, isize align){
+	void* allocation = arena_bump(this, size, align);
+	[[unlikely]] if(allocation == nullptr){
+		return nullptr;
+	}
+	dirty = max(dirty, offset);
 	return allocation;
 }
 
@@ -148,7 +290,7 @@ retry:
 
 		isize last_allocation_size = current - last_allocation;
 		if((current - last_allocation_size + new_size) > limit){
-			if(type == ArenaType::Virtual){
+			if(type != ArenaType::Buffer){
 				isize to_commit = (current - last_allocation_size + new_size) - limit;
 				if(data.push(to_commit) != nullptr){
 					goto retry;
@@ -159,6 +301,7 @@ retry:
 		}
 
 		offset += new_size - last_allocation_size;
+		dirty = max(dirty, offset);
 		return ptr;
 	}
 
@@ -168,7 +311,7 @@ retry:
 void* Arena::realloc(void* ptr, isize old_size, isize new_size, isize align){
 	void* new_ptr = this->resize_in_place(ptr, new_size);
 	if(new_ptr == nullptr){
-		new_ptr = this->alloc(new_size, align);
+		new_ptr = this->alloc_non_zeroed(new_size, align);
 		if(new_ptr != nullptr){
 			mem_copy_no_overlap(new_ptr, ptr, min(old_size, new_size));
 		}
@@ -177,7 +320,22 @@ void* Arena::realloc(void* ptr, isize old_size, isize new_size, isize align){
 }
 
 void Arena::free_all(){
-	offset = 0;
+	if(type == ArenaType::Chained){
+		auto current = (ArenaBlock*)data.pointer;
+		if(current == nullptr){ return; }
+
+		ArenaBlock* prev = nullptr;
+		for(ArenaBlock* blk = current->prev; blk != nullptr; blk = prev){
+			prev = blk->prev;
+			arena_chain_retire(this, blk);
+		}
+		current->prev = nullptr;
+		offset = sizeof(ArenaBlock);
+	}
+	else {
+		offset = 0;
+	}
+	last_allocation = 0;
 }
 
 void Arena::destroy(){
@@ -185,5 +343,89 @@ void Arena::destroy(){
 	if(type == ArenaType::Virtual){
 		data.destroy();
 	}
+	else if(type == ArenaType::Chained){
+		ArenaBlock* next = nullptr;
+		for(ArenaBlock* blk = free_blocks; blk != nullptr; blk = next){
+			next = blk->prev;
+			PageBlock blk_data = blk->data;
+			blk_data.destroy();
+		}
+		free_blocks = nullptr;
+		free_block_count = 0;
+
+		if(data.pointer != nullptr){
+			data.destroy();
+		}
+	}
+}
+
+
+ArenaTemp ArenaTemp::make(Arena* arena){
+	ArenaTemp tmp = {
+		.arena = arena,
+		.block = arena->data.pointer,
+		.offset = arena->offset,
+		.last_allocation = arena->last_allocation,
+	};
+	return tmp;
+}
+
+void ArenaTemp::restore(){
+	debug_assert(arena->data.pointer != block || arena->offset >= offset, "Arena was freed past temporary checkpoint");
+	while(arena->data.pointer != block){
+		auto current = (ArenaBlock*)arena->data.pointer;
+		ensure(current->prev != nullptr, "Arena was freed past temporary checkpoint");
+		ArenaBlock* prev = current->prev;
+		current->data = arena->data;
+		current->dirty = arena->dirty;
+		arena_chain_retire(arena, current);
+		arena->data = prev->data;
+		arena->dirty = prev->dirty;
+	}
+	arena->offset = offset;
+	arena->last_allocation = last_allocation;
 }
 
+struct ScratchArenas {
+	Arena arenas[scratch_arena_count];
+	bool initialized;
+
+	~ScratchArenas(){
+		if(!initialized){ return; }
+		for(isize i = 0; i < scratch_arena_count; i += 1){
+			arenas[i].destroy();
+		}
+	}
+};
+
+static thread_local ScratchArenas scratch_arenas;
+
+ArenaTemp scratch_begin(Slice<Arena*> conflicts){
+	[[unlikely]] if(!scratch_arenas.initialized){
+		for(isize i = 0; i < scratch_arena_count; i += 1){
+			scratch_arenas.arenas[i] = Arena::make_virtual(scratch_arena_reserve);
+		}
+		scratch_arenas.initialized = true;
+	}
+
+	for(isize i = 0; i < scratch_arena_count; i += 1){
+		Arena* candidate = &scratch_arenas.arenas[i];
+		bool conflicting = false;
+		for(isize j = 0; j < conflicts.len(); j += 1){
+			if(conflicts[j] == candidate){
+				conflicting = true;
+				break;
+			}
+		}
+
+		if(!conflicting){
+			return ArenaTemp::make(candidate);
+		}
+	}
+
+	panic("No scratch arena available that does not conflict");
+}
+
+ArenaTemp scratch_begin(Arena* conflict){
+	return scratch_begin(Slice<Arena*>(&conflict, 1));
+}
@@ -4,9 +4,18 @@
 #include "assert.cpp"
 #include "memory.cpp"
 #include "arena.cpp"
+#include "pool.cpp"
+#include "stack.cpp"
+#include "tlsf.cpp"
+#include "thread_heap.cpp"
 #include "utf8.cpp"
 #include "strings.cpp"
+#include "bitset.cpp"
+#include "hash.cpp"
+#include "sort.cpp"
+#include "intern.cpp"
 #include "heap_allocator.cpp"
+#include "tracking_allocator.cpp"
 
 #include "virtual_memory.cpp"
 #if defined(PLATFORM_OS_WINDOWS)
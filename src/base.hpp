@@ -6,6 +6,9 @@
 #include <stdbool.h>
 #include <stdalign.h>
 #include <atomic>
+#include <new>
+#include <type_traits>
+#include <source_location>
 
 using i8  = int8_t;
 using i16 = int16_t;
@@ -33,6 +36,16 @@ constexpr isize cache_line_size = 64;
 template<typename T>
 using Atomic = std::atomic<T>;
 
+// Hint to the CPU that we are busy waiting
+static inline
+void spin_pause(){
+	#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+	#elif defined(__aarch64__)
+	asm volatile("yield");
+	#endif
+}
+
 template<typename A, typename B = A>
 struct Pair {
 	A a;
@@ -50,6 +63,13 @@ void swap_bytes(T* data){
 	}
 }
 
+template<typename T>
+void swap(T* a, T* b){
+	T tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
 template<typename T>
 T abs(T x){
 	return (x < static_cast<T>(0)) ? - x : x;
@@ -266,13 +286,56 @@ Utf8EncodeResult utf8_encode(rune c);
 
 Utf8DecodeResult utf8_decode(Slice<byte> buf);
 
+// Offset of the first byte of the first invalid sequence, -1 if all of `buf` is
+// valid UTF-8. Overlong encodings, surrogates, code points past U+10FFFF and
+// truncated sequences are all errors.
+isize utf8_validate(Slice<byte> buf);
+
 struct Utf8Iterator {
 	Slice<byte> data;
 	isize current;
 };
 
+// Number of code points in valid UTF-8, counted as bytes that are not
+// continuation bytes. Works 16 bytes at a time.
+isize utf8_rune_count(Slice<byte> buf);
+
+enum class TranscodeError : u32 {
+	None = 0,
+	InvalidSequence, // Input is not valid in its encoding
+	OutputTooSmall,
+	OutOfMemory,
+};
+
+struct TranscodeResult {
+	isize written;  // Code units written to the output
+	isize position; // Input code units consumed, on error this is where the bad sequence starts
+	TranscodeError error;
+};
+
+// Exact output sizes in code units for valid input, upper bounds otherwise.
+// The UTF-32 length of UTF-8 is its utf8_rune_count().
+isize utf16_length_from_utf8(Slice<byte> buf);
+
+isize utf8_length_from_utf16(Slice<u16> buf);
+
+isize utf8_length_from_utf32(Slice<rune> buf);
+
+// Convert into `dst`, stopping at the first invalid sequence or when `dst` is full
+TranscodeResult utf8_to_utf16(Slice<byte> src, Slice<u16> dst);
+
+TranscodeResult utf8_to_utf32(Slice<byte> src, Slice<rune> dst);
+
+TranscodeResult utf16_to_utf8(Slice<u16> src, Slice<byte> dst);
+
+TranscodeResult utf32_to_utf8(Slice<rune> src, Slice<byte> dst);
+
 bool iter_next(Utf8Iterator* it, rune* r, i32* len);
 
+// Consume the run of ASCII bytes at the iterator's position (possibly empty)
+// and return it, so callers can handle plain text in bulk
+Slice<byte> iter_next_ascii(Utf8Iterator* it);
+
 bool iter_prev(Utf8Iterator* it, rune* r, i32* len);
 
 rune iter_next(Utf8Iterator* it);
@@ -374,8 +437,12 @@ enum class AllocatorMode : u32 {
 	Free     = 3, // Mark allocation as free
 	FreeAll  = 4, // Mark allocations as free
 	Realloc  = 5, // Re-allocate pointer
+
+	AllocNonZeroed = 6, // Allocate a chunk of memory without clearing it
 };
 
+constexpr isize allocator_mode_count = 7;
+
 enum class MemoryError : u32 {
 	None = 0,
 
@@ -413,7 +480,11 @@ struct Allocator {
 
 	Result<void*, MemoryError> alloc(isize nbytes, isize align);
 
-	Result<void*, MemoryError> resize(void* ptr, isize new_size);
+	// Same as alloc, but the memory's contents are unspecified. Allocators that
+	// do not support it fall back to a regular alloc.
+	Result<void*, MemoryError> alloc_non_zeroed(isize nbytes, isize align);
+
+	Result<void*, MemoryError> resize(void* ptr, isize old_size, isize new_size);
 
 	void free(void* ptr, isize old_size, isize align);
 
@@ -451,12 +522,16 @@ void destroy(Allocator a, String s){
 }
 
 //// Virtual Memory ///////////////////////////////////////////////////////////
-constexpr isize mem_page_size = 4096;
+constexpr u32 mem_page_huge          = (1 << 0); // Prefer (transparent) huge pages
+constexpr u32 mem_page_huge_explicit = (1 << 1); // Require huge pages (hugetlb), reserving fails if the pool has too few. Unsupported on Windows.
+constexpr u32 mem_page_prefault      = (1 << 2); // Fault in pages as soon as they are committed
 
 struct PageBlock {
 	isize reserved;
 	isize commited;
 	void* pointer;
+	isize commit_chunk; // Commits and decommits happen in multiples of this
+	u32 flags;
 
 	void* push(isize nbytes);
 
@@ -464,16 +539,26 @@ struct PageBlock {
 
 	void destroy();
 
-	static PageBlock make(isize nbytes);
+	// A `commit_chunk` of 0 uses the smallest size allowed by `flags`
+	static PageBlock make(isize nbytes, isize commit_chunk = 0, u32 flags = 0);
 };
 
-void* virtual_reserve(isize nbytes);
+// Size of a regular memory page, detected at runtime
+isize virtual_page_size();
+
+// Size of a huge memory page, 0 if the system does not support them
+isize virtual_huge_page_size();
+
+// Size of the pages backing mem_page_huge_explicit mappings, 0 if unavailable
+isize virtual_explicit_huge_page_size();
+
+void* virtual_reserve(isize nbytes, u32 flags = 0);
 
 void virtual_release(void* pointer, isize nbytes);
 
 bool virtual_protect(void* pointer, u32 prot);
 
-void* virtual_commit(void* pointer, isize nbytes);
+void* virtual_commit(void* pointer, isize nbytes, u32 flags = 0);
 
 void virtual_decommit(void* pointer, isize nbytes);
 
@@ -482,6 +567,14 @@ void virtual_decommit(void* pointer, isize nbytes);
 enum struct ArenaType : u32 {
 	Buffer  = 0,
 	Virtual = 1,
+	Chained = 2,
+};
+
+// Header stored at the start of every block owned by a chained arena
+struct ArenaBlock {
+	PageBlock data;
+	isize dirty;
+	ArenaBlock* prev; // Previous block in use, or next retained block when free
 };
 
 struct Arena {
@@ -489,9 +582,18 @@ struct Arena {
 	isize offset;
 	uintptr last_allocation;
 	ArenaType type;
+	isize dirty; // Offset up to which memory may have been written since it was committed
+
+	// Only used by chained arenas
+	ArenaBlock* free_blocks;
+	isize free_block_count;
+	isize max_free_blocks;
+	isize block_size;
 
 	void* alloc(isize nbytes, isize align);
 
+	void* alloc_non_zeroed(isize nbytes, isize align);
+
 	void* resize_in_place(void* ptr, isize new_size);
 
 	void* realloc(void* ptr, isize old_size, isize new_size, isize align);
@@ -505,6 +607,201 @@ struct Arena {
 	static Arena from_buffer(Slice<u8> buf);
 
 	static Arena make_virtual(isize reserve);
+
+	// Arena that reserves a new block of (at least) `block_size` whenever the
+	// current one fills up, `free_all` keeps up to `max_free_blocks` for reuse.
+	static Arena make_chained(isize block_size, isize max_free_blocks = 1);
+};
+
+// Snapshot of an arena's state, restoring it releases everything allocated
+// after the snapshot was taken in O(1)
+struct ArenaTemp {
+	Arena*  arena;
+	void*   block;
+	isize   offset;
+	uintptr last_allocation;
+
+	void restore();
+
+	static ArenaTemp make(Arena* arena);
+};
+
+//// Scratch Arenas ///////////////////////////////////////////////////////////
+constexpr isize scratch_arena_count   = 2;
+constexpr isize scratch_arena_reserve = 64 * mem_MiB;
+
+// Begin a temporary region in one of the current thread's scratch arenas,
+// skipping any arena in `conflicts` (usually the arena the caller passed in to
+// allocate the result). Call `restore()` on the result when done.
+ArenaTemp scratch_begin(Slice<Arena*> conflicts = Slice<Arena*>());
+
+ArenaTemp scratch_begin(Arena* conflict);
+
+//// Pool /////////////////////////////////////////////////////////////////////
+// Intrusive free list node, stored inside of freed slots
+struct PoolFreeNode {
+	PoolFreeNode* next;
+};
+
+// Fixed-size slot allocator, slots can be freed in any order
+struct Pool {
+	PageBlock data;
+	isize offset; // Bytes of data handed out as slots, free or not
+	isize slot_size;
+	isize slot_align;
+	PoolFreeNode* free_list;
+
+	void* alloc();
+
+	void* alloc_non_zeroed();
+
+	void free(void* ptr);
+
+	void free_all();
+
+	void destroy();
+
+	Allocator as_allocator();
+
+	static Pool make(isize slot_size, isize slot_align, isize reserve);
+};
+
+//// Stack ////////////////////////////////////////////////////////////////////
+// Stored right before every stack allocation
+struct StackHeader {
+	isize prev_offset; // Stack offset before this allocation was made
+	isize prev_top;    // Offset of the previous top allocation, 0 if there was none
+};
+
+// LIFO allocator, only the most recent allocation can be freed or resized
+struct Stack {
+	PageBlock data;
+	isize offset;
+	isize top; // Offset of the most recent allocation, 0 if there is none
+
+	void* alloc(isize nbytes, isize align);
+
+	void* alloc_non_zeroed(isize nbytes, isize align);
+
+	void* resize_in_place(void* ptr, isize new_size);
+
+	void* realloc(void* ptr, isize old_size, isize new_size, isize align);
+
+	// Pops `ptr` off the stack, fails with BadFree unless it is the top
+	MemoryError free(void* ptr);
+
+	void free_all();
+
+	void destroy();
+
+	Allocator as_allocator();
+
+	static Stack make(isize reserve);
+};
+
+//// TLSF /////////////////////////////////////////////////////////////////////
+// Two-Level Segregated Fit allocator, general purpose with O(1) alloc and free.
+// Blocks are carved from a single PageBlock that is committed on demand, a
+// large enough free block at the end of it gets decommitted again.
+constexpr isize tlsf_align          = 16;
+constexpr isize tlsf_sl_count_log2  = 5;
+constexpr isize tlsf_sl_count       = 1 << tlsf_sl_count_log2;
+constexpr isize tlsf_fl_shift       = tlsf_sl_count_log2 + 4; // log2(tlsf_align)
+constexpr isize tlsf_fl_max         = 40; // Blocks up to 1TiB
+constexpr isize tlsf_fl_count       = tlsf_fl_max - tlsf_fl_shift + 1;
+constexpr isize tlsf_trim_threshold = 256 * mem_KiB;
+
+struct TlsfBlock {
+	TlsfBlock* prev_phys;
+	isize      size; // Payload size, lower bits are used as flags
+	// Only valid while the block is free, overlaps the payload
+	TlsfBlock* next_free;
+	TlsfBlock* prev_free;
+};
+
+struct Tlsf {
+	PageBlock data;
+	TlsfBlock* last; // Physically last block
+	u32 fl_bitmap;
+	u32 sl_bitmap[tlsf_fl_count];
+	TlsfBlock* free_blocks[tlsf_fl_count][tlsf_sl_count];
+
+	void* alloc(isize nbytes, isize align);
+
+	void* alloc_non_zeroed(isize nbytes, isize align);
+
+	void* resize_in_place(void* ptr, isize new_size);
+
+	void* realloc(void* ptr, isize old_size, isize new_size, isize align);
+
+	void free(void* ptr);
+
+	void free_all();
+
+	void destroy();
+
+	Allocator as_allocator();
+
+	static Tlsf make(isize reserve);
+};
+
+//// Thread Heap //////////////////////////////////////////////////////////////
+// Thread safe general purpose allocator. Every thread keeps its own spans of
+// same-sized slots, frees from other threads are pushed to a lock-free list in
+// the owning span and picked up by the owner when it runs out of slots.
+constexpr isize thread_heap_span_size       = 64 * mem_KiB;
+constexpr isize thread_heap_max_small_size  = 16 * mem_KiB;
+constexpr isize thread_heap_class_count     = 36;
+constexpr isize thread_heap_max_free_spans  = 64; // Kept committed in the global pool
+constexpr isize thread_heap_rebalance_ticks = 1024;
+
+Allocator thread_heap_allocator();
+
+//// Tracking Allocator ///////////////////////////////////////////////////////
+// Wraps another allocator and records statistics for every call, optionally
+// per call site. Not thread safe.
+constexpr isize tracking_histogram_buckets = 48; // Power of 2 size buckets
+constexpr isize tracking_max_sites         = 256;
+
+struct TrackingStats {
+	i64 count[allocator_mode_count];
+	i64 bytes[allocator_mode_count];
+	i64 failures;
+	i64 live_bytes;
+	i64 peak_live_bytes;
+	i64 histogram[allocator_mode_count][tracking_histogram_buckets];
+};
+
+struct TrackingAllocator;
+
+struct TrackingSite {
+	std::source_location location;
+	TrackingStats stats;
+	TrackingAllocator* parent;
+};
+
+struct TrackingAllocator {
+	Allocator inner;
+	TrackingStats stats;
+	TrackingSite* sites[tracking_max_sites];
+	isize site_count;
+
+	Allocator as_allocator();
+
+	// Allocator that also attributes calls to `location`, falls back to
+	// as_allocator() once tracking_max_sites is reached.
+	Allocator at(std::source_location location = std::source_location::current());
+
+	TrackingStats snapshot() const;
+
+	// Print a summary of the stats and of every call site to stderr
+	void dump() const;
+
+	void reset();
+
+	void destroy();
+
+	static TrackingAllocator make(Allocator inner);
 };
 
 //// Dynamic Array ////////////////////////////////////////////////////////////
@@ -543,38 +840,114 @@ struct DynamicArray {
 
 	void destroy(){
 		_allocator.free(_data, _capacity * sizeof(T), alignof(T));
+		_data = nullptr;
+		_capacity = 0;
+		_length = 0;
 	}
 
 	Slice<T> as_slice(){
 		return Slice<T>(_data, _length);
 	}
 
+	// Change capacity to exactly `new_cap` elements, growing in place when the
+	// allocator supports it.
+	bool _set_capacity(isize new_cap){
+		isize old_size = _capacity * sizeof(T);
+		isize new_size = new_cap * sizeof(T);
+
+		if(_data != nullptr){
+			auto [p, error] = _allocator.resize(_data, old_size, new_size);
+			if(ok(error)){
+				_capacity = new_cap;
+				return true;
+			}
+		}
+
+		auto [new_data, error] = (_data == nullptr)
+			? _allocator.alloc_non_zeroed(new_size, alignof(T))
+			: _allocator.realloc(_data, old_size, new_size, alignof(T));
+		if(!ok(error)){
+			return false;
+		}
+		_data = (T*)new_data;
+		_capacity = new_cap;
+		return true;
+	}
+
+	// Grow geometrically so that at least `needed` elements fit
+	bool _grow(isize needed){
+		isize new_cap = max<isize>(_capacity * 2, 16);
+		new_cap = max(new_cap, needed);
+		return _set_capacity(new_cap);
+	}
+
+	// Make sure `count` elements fit without reallocating
+	bool reserve(isize count){
+		if(count <= _capacity){ return true; }
+		return _set_capacity(count);
+	}
+
+	// Set the length, new elements are value initialized
+	bool resize(isize new_len){
+		bounds_check_assert(new_len >= 0, "Negative length for dynamic array");
+		if(new_len > _capacity && !reserve(new_len)){
+			return false;
+		}
+		for(isize i = _length; i < new_len; i += 1){
+			_data[i] = T{};
+		}
+		_length = new_len;
+		return true;
+	}
+
 	bool append(T elem){
 		[[unlikely]] if(_length >= _capacity){
-			isize new_cap = mem_align_forward_size(_length * 2, 16);
-			auto [new_data, error] = _allocator.realloc(_data, _capacity * sizeof(T), new_cap, alignof(T));
-			if(!ok(error)){
+			if(!_grow(_length + 1)){
 				return false;
 			}
-			_data = (T*)new_data;
 		}
 		_data[_length] = elem;
 		_length += 1;
 		return true;
 	}
 
+	// Append all elements of `elems`, which must not point into this array
+	bool append_slice(Slice<T> elems){
+		isize n = elems.len();
+		[[unlikely]] if(_length + n > _capacity){
+			if(!_grow(_length + n)){
+				return false;
+			}
+		}
+		mem_copy_no_overlap(&_data[_length], elems.raw_data(), n * sizeof(T));
+		_length += n;
+		return true;
+	}
+
+	// Add `count` uninitialized elements at the end and return them to be
+	// filled in directly, returns an empty slice on failure.
+	Slice<T> extend(isize count){
+		[[unlikely]] if(_length + count > _capacity){
+			if(!_grow(_length + count)){
+				return Slice<T>();
+			}
+		}
+		auto s = Slice<T>(&_data[_length], count);
+		_length += count;
+		return s;
+	}
+
 	bool pop(){
 		if(_length <= 0){ return false; }
 		_length -= 1;
-		auto v = _data[_length];
-		return v;
+		return true;
 	}
 
 	bool insert(isize idx, T elem){
-		bounds_check_assert(idx >= 0 && idx <= _length, "Out of bounds index to insert_swap");
-		if(idx == _length){ return append(this, elem); }
+		bounds_check_assert(idx >= 0 && idx <= _length, "Out of bounds index to insert");
+		if(idx == _length){ return append(elem); }
 
-		bool ok = append(this, elem);
+		bool ok = append(elem);
 		if(!ok){ return false; }
 
 		isize nbytes = sizeof(T) * (_length - 1 - idx);
@@ -585,9 +958,9 @@ struct DynamicArray {
 
 	bool insert_swap(isize idx, T elem){
 		bounds_check_assert(idx >= 0 && idx <= _length, "Out of bounds index to insert_swap");
-		if(idx == _length){ return append(this, elem); }
+		if(idx == _length){ return append(elem); }
 
-		bool ok = append(this, _data[idx]);
+		bool ok = append(_data[idx]);
 		[[unlikely]] if(!ok){ return false; }
 		_data[idx] = elem;
 
@@ -603,22 +976,28 @@ struct DynamicArray {
 
 	void remove(isize idx){
 		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds index to remove");
-		isize nbytes = sizeof(T) * (_length - idx + 1);
+		isize nbytes = sizeof(T) * (_length - idx - 1);
 		mem_copy(&_data[idx], &_data[idx+1], nbytes);
 		_length -= 1;
 	}
 
 	static Pair<DynamicArray<T>, MemoryError> make(Allocator alloc, isize initial_cap = 16){
-		DynamicArray<T> arr;
-		arr._capacity = initial_cap;
-		arr._length = 0;
-		arr._allocator = alloc;
+		DynamicArray<T> arr = {
+			._data = nullptr,
+			._capacity = 0,
+			._length = 0,
+			._allocator = alloc,
+		};
+		if(initial_cap <= 0){
+			return {arr, MemoryError::None};
+		}
 
 		auto [buffer, error] = alloc.alloc(initial_cap * sizeof(T), alignof(T));
 		if(!ok(error)){
 			return {arr, error};
 		}
 		arr._data = (T*)buffer;
+		arr._capacity = initial_cap;
 
 		return {arr, MemoryError::None};
 	}
@@ -630,193 +1009,1774 @@ struct DynamicArray {
 	Allocator allocator() const { return _allocator; }
 };
 
-//// Map //////////////////////////////////////////////////////////////////////
-#include "debug_print.cpp"
+//// Slot Map /////////////////////////////////////////////////////////////////
+// Stable reference to a slot map value. Removing the value bumps the slot's
+// generation, so old handles stop resolving instead of aliasing a new value.
+// The zero handle is never valid.
+struct SlotHandle {
+	u32 index;
+	u32 generation;
 
-static inline
-u64 map_hash_fnv64(byte const * data, isize nbytes){
-	constexpr u64 prime = 0x100000001b3ull;
-	constexpr u64 offset_basis = 0xcbf29ce484222325ull;
+	bool operator==(SlotHandle h) const { return index == h.index && generation == h.generation; }
+	bool operator!=(SlotHandle h) const { return !(*this == h); }
+};
 
-	u64 hash = offset_basis;
-	for(isize i = 0; i < nbytes; i ++){
-		auto b = u64(data[i]);
-		hash = hash ^ b;
-		hash = hash * prime;
-	}
+constexpr u32 slot_map_no_free = 0xffffffff;
 
-	return hash | u64(hash == 0);
-}
+struct SlotMapEntry {
+	u32 dense_index; // Next free slot while the slot is unused
+	u32 generation;
+};
 
-// template<typename K, typename V>
-// struct MapSlot {
-// 	K key;
-// 	V value;
-// 	u64 hash;
-// 	MapSlot* next;
-// };
-//
-// template<typename K, typename V>
-// struct Map {
-// 	MapSlot<K, V>* base_slots;
-// 	isize capacity;
-// 	Allocator allocator;
-// };
-//
-// template<typename K, typename V>
-// Map<K, V> map_create(Allocator allocator, isize capacity){
-// 	ensure((capacity & (capacity - 1)) == 0, "Capacity must be a power of 2");
-// 	Map<K, V> m;
-// 	auto base_slots = allocator.alloc(capacity * sizeof(MapSlot<K, V>), alignof(MapSlot<K, V>));
-// 	if(!base_slots){ return m; }
-//
-// 	m.base_slots = static_cast<MapSlot<K, V>*>(base_slots);
-// 	m.capacity = capacity;
-// 	m.allocator = allocator;
-//
-// 	return m;
-// }
-//
-// template<typename K, typename V>
-// void destroy(Map<K, V>* map){
-// 	constexpr isize slot_size = sizeof(MapSlot<K, V>);
-// 	constexpr isize slot_align = alignof(MapSlot<K, V>);
-// 	for(isize i = 0; i < map->capacity; i++){
-// 		MapSlot<K, V>* next = nullptr;
-// 		for(MapSlot<K, V>* slot = map->base_slots[i].next; slot != nullptr; slot = next){
-// 			next = slot->next;
-// 			map->allocator.free((byte*)slot, slot_size, slot_align);
-// 		}
-// 	}
-//
-// 	mem_free(map->allocator, (byte*)map->base_slots, slot_size * map->capacity, slot_align);
-// }
-//
-// template<typename K, typename V>
-// Pair<isize, u64> map_slot_offset(Map<K, V>* map, K key){
-// 	auto data   = (byte const*)&key;
-// 	auto hash   = map_hash_fnv64(data, sizeof(key));
-// 	isize pos    = isize(hash & (map->capacity - 1));
-// 	return {pos, hash};
-// }
-//
-// template<typename V>
-// Pair<isize, u64> map_slot_offset(Map<String, V>* map, String key){
-// 	auto hash   = map_hash_fnv64(key.raw_data(), key.len());
-// 	isize pos    = isize(hash & (map->capacity - 1));
-// 	return {pos, hash};
-// }
-//
-// template<typename K, typename V, typename PK = K>
-// Pair<V, bool> map_get(Map<K, V>* map, PK key){
-// 	auto map_key = K(key);
-// 	auto [pos, hash] = map_slot_offset(map, map_key);
-//
-// 	for(auto slot = &map->base_slots[pos]; slot != nullptr; slot = slot->next){
-// 		bool hit = (slot->hash == hash) && (slot->key == map_key);
-// 		if(hit){
-// 			return {slot->value, true};
-// 		}
-// 	}
-// 	return {V{}, false};
-// }
-//
-// template<typename K, typename V, typename PK = K, typename PV = V>
-// bool map_set(Map<K, V>* map, PK map_key, PV map_val){
-// 	auto key = static_cast<K>(map_key);
-// 	auto val = static_cast<V>(map_val);
-//
-// 	auto [pos, hash] = map_slot_offset(map, key);
-//
-// 	if(map->base_slots[pos].hash == 0){
-// 		map->base_slots[pos].key   = key;
-// 		map->base_slots[pos].value = val;
-// 		map->base_slots[pos].hash  = hash;
-// 	}
-// 	else {
-// 		MapSlot<K, V>* new_slot = make<MapSlot<K, V>>(map->allocator);
-// 		if(new_slot == nullptr){
-// 			return false;
-// 		}
-//
-// 		*new_slot = map->base_slots[pos];
-//
-// 		map->base_slots[pos].key   = key;
-// 		map->base_slots[pos].value = val;
-// 		map->base_slots[pos].hash  = hash;
-// 		map->base_slots[pos].next  = new_slot;
-// 	}
-// 	return true;
-// }
+// Values are kept packed at the front of one array (removal moves the last one
+// into the hole), handles go through a slot table that tracks where each value
+// currently is.
+template<typename T>
+struct SlotMap {
+	DynamicArray<T>            _values;
+	DynamicArray<u32>          _value_slots; // Slot owning each value
+	DynamicArray<SlotMapEntry> _slots;
+	u32                        _free_head;
+
+	Result<SlotHandle, MemoryError> insert(T value){
+		if(!_values.reserve(_values.len() + 1) || !_value_slots.reserve(_values.len() + 1)){
+			return { .value = {}, .error = MemoryError::OutOfMemory };
+		}
 
-//// Heap Allocator (LibC) ////////////////////////////////////////////////////
-Allocator heap_allocator();
+		u32 slot = _free_head;
+		if(slot == slot_map_no_free){
+			ensure(_slots.len() < isize(slot_map_no_free), "Slot map ran out of slots");
+			auto entry = SlotMapEntry{ .dense_index = 0, .generation = 1 };
+			if(!_slots.append(entry)){
+				return { .value = {}, .error = MemoryError::OutOfMemory };
+			}
+			slot = u32(_slots.len() - 1);
+		}
+		else {
+			_free_head = _slots[slot].dense_index;
+		}
 
-//// String Utilities /////////////////////////////////////////////////////////
-String str_trim(String s, String cutset);
+		SlotMapEntry& entry = _slots[slot];
+		entry.dense_index = u32(_values.len());
+		_values.append(value);
+		_value_slots.append(slot);
 
-String str_trim_leading(String s, String cutset);
+		return { .value = SlotHandle{ .index = slot, .generation = entry.generation }, .error = MemoryError::None };
+	}
 
-String str_trim_trailing(String s, String cutset);
+	bool contains(SlotHandle h) const {
+		return h.index < u32(_slots.len()) && _slots[h.index].generation == h.generation;
+	}
 
-isize str_rune_count(String s);
+	// Pointer to the value, nullptr for stale handles. Only valid until the map
+	// is modified.
+	T* get(SlotHandle h){
+		if(!contains(h)){ return nullptr; }
+		return &_values[_slots[h.index].dense_index];
+	}
 
-bool str_starts_with(String s, String prefix);
+	bool remove(SlotHandle h){
+		if(!contains(h)){ return false; }
 
-bool str_ends_with(String s, String suffix);
+		SlotMapEntry& entry = _slots[h.index];
+		u32 dense = entry.dense_index;
+		u32 last  = u32(_values.len() - 1);
 
-isize str_find(String s, String substr, isize start = 0);
+		if(dense != last){
+			u32 moved_slot = _value_slots[last];
+			_values[dense] = _values[last];
+			_value_slots[dense] = moved_slot;
+			_slots[moved_slot].dense_index = dense;
+		}
+		_values.pop();
+		_value_slots.pop();
+
+		// Skip 0 on wrap around so the zero handle stays invalid
+		entry.generation += 1;
+		if(entry.generation == 0){ entry.generation = 1; }
+		entry.dense_index = _free_head;
+		_free_head = h.index;
+		return true;
+	}
 
-[[nodiscard]]
-String str_clone(String s, Allocator allocator);
+	// Handle of the value at position `idx` of as_slice()
+	SlotHandle handle_at(isize idx) const {
+		u32 slot = _value_slots[idx];
+		return SlotHandle{ .index = slot, .generation = _slots[slot].generation };
+	}
 
-[[nodiscard]]
-String str_concat(String s0, String s1, Allocator allocator);
+	// All values, packed. Order changes when values are removed.
+	Slice<T> as_slice(){
+		return _values.as_slice();
+	}
 
-//// String Builder ///////////////////////////////////////////////////////////
-// struct StringBuilder {
-// 	DynamicArray<byte> buffer;
-// };
-//
-// StringBuilder str_builder_create(Allocator allocator);
-//
-// void str_append(StringBuilder* sb, String v);
-// void str_append(StringBuilder* sb, rune v);
-// void str_append(StringBuilder* sb, i64 v);
-// void str_append(StringBuilder* sb, f64 v);
-// void str_append(StringBuilder* sb, bool v);
+	// Remove every value, invalidating all handles
+	void clear(){
+		for(isize i = 0; i < _value_slots.len(); i += 1){
+			SlotHandle h = handle_at(i);
+			SlotMapEntry& entry = _slots[h.index];
+			entry.generation += 1;
+			if(entry.generation == 0){ entry.generation = 1; }
+			entry.dense_index = _free_head;
+			_free_head = h.index;
+		}
+		_values.clear();
+		_value_slots.clear();
+	}
 
-//// SIMD /////////////////////////////////////////////////////////////////////
-namespace simd {
-#define VECTOR_DECL(T, N) __attribute__((vector_size((N) * sizeof(T)))) T;
+	void destroy(){
+		_values.destroy();
+		_value_slots.destroy();
+		_slots.destroy();
+		_free_head = slot_map_no_free;
+	}
 
-// 128-bit
-using i8x16 = VECTOR_DECL(i8, 16);
-using i16x8 = VECTOR_DECL(i16, 8);
-using i32x4 = VECTOR_DECL(i32, 4);
-using i64x2 = VECTOR_DECL(i64, 2);
+	static Pair<SlotMap<T>, MemoryError> make(Allocator alloc, isize initial_cap = 16){
+		SlotMap<T> m = {};
+		m._free_head = slot_map_no_free;
+
+		auto [values, e0] = DynamicArray<T>::make(alloc, initial_cap);
+		auto [value_slots, e1] = DynamicArray<u32>::make(alloc, initial_cap);
+		auto [slots, e2] = DynamicArray<SlotMapEntry>::make(alloc, initial_cap);
+		m._values = values;
+		m._value_slots = value_slots;
+		m._slots = slots;
+		if(!ok(e0) || !ok(e1) || !ok(e2)){
+			m.destroy();
+			return {m, MemoryError::OutOfMemory};
+		}
+		return {m, MemoryError::None};
+	}
 
-using u8x16 = VECTOR_DECL(u8, 16);
-using u16x8 = VECTOR_DECL(u16, 8);
-using u32x4 = VECTOR_DECL(u32, 4);
-using u64x2 = VECTOR_DECL(u64, 2);
+	// Accessors
+	isize len() const { return _values.len(); }
+	Allocator allocator() const { return _values.allocator(); }
+};
 
-using f32x4 = VECTOR_DECL(f32, 4);
-using f64x2 = VECTOR_DECL(f64, 2);
+//// Small Array //////////////////////////////////////////////////////////////
+// Array that stores its first N elements inline and only goes to the
+// allocator once it outgrows them.
+template<typename T, isize N>
+struct SmallArray {
+	static_assert(N > 0, "Inline capacity must be positive");
 
-// 256-bit
-using i8x32  = VECTOR_DECL(i8, 32);
-using i16x16 = VECTOR_DECL(i16, 16);
-using i32x8  = VECTOR_DECL(i32, 8);
-using i64x4  = VECTOR_DECL(i64, 4);
+	T         _inline[N];
+	T*        _heap; // Null while the elements are inline
+	isize     _capacity;
+	isize     _length;
+	Allocator _allocator;
 
-using u8x32  = VECTOR_DECL(u8, 32);
+	T* _items(){ return _heap != nullptr ? _heap : _inline; }
+	T const* _items() const { return _heap != nullptr ? _heap : _inline; }
+
+	T& operator[](isize idx){
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds access to small array");
+		return _items()[idx];
+	}
+
+	T const& operator[](isize idx) const{
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds access to small array");
+		return _items()[idx];
+	}
+
+	void clear(){
+		_length = 0;
+	}
+
+	void destroy(){
+		if(_heap != nullptr){
+			_allocator.free(_heap, _capacity * sizeof(T), alignof(T));
+		}
+		_heap = nullptr;
+		_capacity = N;
+		_length = 0;
+	}
+
+	Slice<T> as_slice(){
+		return Slice<T>(_items(), _length);
+	}
+
+	// Move the elements into a heap buffer of `new_cap` elements
+	bool _grow(isize needed){
+		isize new_cap = max(_capacity * 2, needed);
+		isize old_size = _capacity * sizeof(T);
+		isize new_size = new_cap * sizeof(T);
+
+		if(_heap == nullptr){
+			auto [buf, error] = _allocator.alloc_non_zeroed(new_size, alignof(T));
+			if(!ok(error)){ return false; }
+			mem_copy_no_overlap(buf, _inline, _length * sizeof(T));
+			_heap = (T*)buf;
+		}
+		else {
+			auto [p, resize_error] = _allocator.resize(_heap, old_size, new_size);
+			if(!ok(resize_error)){
+				auto [buf, error] = _allocator.realloc(_heap, old_size, new_size, alignof(T));
+				if(!ok(error)){ return false; }
+				_heap = (T*)buf;
+			}
+		}
+		_capacity = new_cap;
+		return true;
+	}
+
+	bool reserve(isize count){
+		if(count <= _capacity){ return true; }
+		return _grow(count);
+	}
+
+	bool append(T elem){
+		[[unlikely]] if(_length >= _capacity){
+			if(!_grow(_length + 1)){ return false; }
+		}
+		_items()[_length] = elem;
+		_length += 1;
+		return true;
+	}
+
+	// Append all elements of `elems`, which must not point into this array
+	bool append_slice(Slice<T> elems){
+		isize n = elems.len();
+		[[unlikely]] if(_length + n > _capacity){
+			if(!_grow(_length + n)){ return false; }
+		}
+		mem_copy_no_overlap(&_items()[_length], elems.raw_data(), n * sizeof(T));
+		_length += n;
+		return true;
+	}
+
+	bool pop(){
+		if(_length <= 0){ return false; }
+		_length -= 1;
+		return true;
+	}
+
+	void remove_swap(isize idx){
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds index to remove_swap");
+		T* items = _items();
+		items[idx] = items[_length - 1];
+		_length -= 1;
+	}
+
+	void remove(isize idx){
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds index to remove");
+		T* items = _items();
+		mem_copy(&items[idx], &items[idx+1], sizeof(T) * (_length - idx - 1));
+		_length -= 1;
+	}
+
+	static SmallArray<T, N> make(Allocator alloc){
+		SmallArray<T, N> arr;
+		arr._heap = nullptr;
+		arr._capacity = N;
+		arr._length = 0;
+		arr._allocator = alloc;
+		return arr;
+	}
+
+	// Accessors
+	isize len() const { return _length; }
+	isize cap() const { return _capacity; }
+	bool is_inline() const { return _heap == nullptr; }
+	T* raw_data() { return _items(); }
+	Allocator allocator() const { return _allocator; }
+};
+
+//// Multi Array //////////////////////////////////////////////////////////////
+// Every column starts on this boundary, so column data can be loaded straight
+// into simd:: vectors
+constexpr isize multi_array_column_align = cache_line_size;
+
+template<isize I, typename T, typename... Rest>
+struct _PackType { using Type = typename _PackType<I - 1, Rest...>::Type; };
+
+template<typename T, typename... Rest>
+struct _PackType<0, T, Rest...> { using Type = T; };
+
+// Struct of arrays: one column per field, all columns in a single allocation
+// and sharing a length and capacity.
+template<typename... Fields>
+struct MultiArray {
+	static constexpr isize field_count = sizeof...(Fields);
+	static_assert(field_count > 0, "MultiArray needs at least one field");
+	static_assert(((alignof(Fields) <= multi_array_column_align) && ...), "Field alignment is too large");
+
+	template<isize I>
+	using Field = typename _PackType<I, Fields...>::Type;
+
+	byte*     _data;
+	isize     _capacity;
+	isize     _length;
+	Allocator _allocator;
+
+	// Byte offset of column `index` for a given capacity, or the total size
+	// when `index` == field_count
+	static isize _column_offset(isize cap, isize index){
+		constexpr isize sizes[] = { isize(sizeof(Fields))... };
+		isize offset = 0;
+		for(isize i = 0; i < index; i += 1){
+			offset += mem_align_forward_size(cap * sizes[i], multi_array_column_align);
+		}
+		return offset;
+	}
+
+	template<isize I>
+	Field<I>* _column_data() const {
+		return (Field<I>*)(_data + _column_offset(_capacity, I));
+	}
+
+	template<isize I>
+	Slice<Field<I>> column(){
+		static_assert(I >= 0 && I < field_count, "Column index out of range");
+		return Slice<Field<I>>(_column_data<I>(), _length);
+	}
+
+	template<isize I>
+	Field<I>& get(isize idx){
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds access to multi array");
+		return _column_data<I>()[idx];
+	}
+
+	template<isize I, typename T, typename... Rest>
+	void _store(isize idx, T const& value, Rest const&... rest){
+		_column_data<I>()[idx] = value;
+		if constexpr(sizeof...(Rest) > 0){
+			_store<I + 1>(idx, rest...);
+		}
+	}
+
+	template<isize I>
+	void _move(isize to, isize from){
+		auto col = _column_data<I>();
+		col[to] = col[from];
+		if constexpr(I + 1 < field_count){
+			_move<I + 1>(to, from);
+		}
+	}
+
+	// Columns are at different offsets for every capacity, so growing always
+	// copies each column to its new place
+	bool reserve(isize count){
+		if(count <= _capacity){ return true; }
+
+		isize new_size = _column_offset(count, field_count);
+		auto [buf, error] = _allocator.alloc_non_zeroed(new_size, multi_array_column_align);
+		if(!ok(error)){ return false; }
+
+		if(_data != nullptr){
+			constexpr isize sizes[] = { isize(sizeof(Fields))... };
+			for(isize i = 0; i < field_count; i += 1){
+				mem_copy_no_overlap((byte*)buf + _column_offset(count, i), _data + _column_offset(_capacity, i), _length * sizes[i]);
+			}
+			_allocator.free(_data, _column_offset(_capacity, field_count), multi_array_column_align);
+		}
+		_data = (byte*)buf;
+		_capacity = count;
+		return true;
+	}
+
+	bool append(Fields const&... values){
+		[[unlikely]] if(_length >= _capacity){
+			if(!reserve(max<isize>(_capacity * 2, 16))){ return false; }
+		}
+		_store<0>(_length, values...);
+		_length += 1;
+		return true;
+	}
+
+	void set(isize idx, Fields const&... values){
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds access to multi array");
+		_store<0>(idx, values...);
+	}
+
+	void remove_swap(isize idx){
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds index to remove_swap");
+		_move<0>(idx, _length - 1);
+		_length -= 1;
+	}
+
+	void clear(){
+		_length = 0;
+	}
+
+	void destroy(){
+		if(_data != nullptr){
+			_allocator.free(_data, _column_offset(_capacity, field_count), multi_array_column_align);
+		}
+		_data = nullptr;
+		_capacity = 0;
+		_length = 0;
+	}
+
+	static Pair<MultiArray<Fields...>, MemoryError> make(Allocator alloc, isize initial_cap = 16){
+		MultiArray<Fields...> arr = {
+			._data = nullptr,
+			._capacity = 0,
+			._length = 0,
+			._allocator = alloc,
+		};
+		if(!arr.reserve(initial_cap)){
+			return {arr, MemoryError::OutOfMemory};
+		}
+		return {arr, MemoryError::None};
+	}
+
+	// Accessors
+	isize len() const { return _length; }
+	isize cap() const { return _capacity; }
+	Allocator allocator() const { return _allocator; }
+};
+
+//// Ring Buffer //////////////////////////////////////////////////////////////
+// Growable FIFO over a power of two buffer. Head and tail are free running
+// counters, so the number of elements is always tail - head.
+template<typename T>
+struct RingBuffer {
+	T*        _data;
+	isize     _capacity;
+	isize     _head;
+	isize     _tail;
+	Allocator _allocator;
+
+	T& operator[](isize idx){
+		bounds_check_assert(idx >= 0 && idx < len(), "Out of bounds access to ring buffer");
+		return _data[(_head + idx) & (_capacity - 1)];
+	}
+
+	// Copy `count` elements starting at logical position `pos` into `out`
+	void _copy_out(T* out, isize pos, isize count) const {
+		isize start = pos & (_capacity - 1);
+		isize first = min(count, _capacity - start);
+		mem_copy_no_overlap(out, &_data[start], first * sizeof(T));
+		mem_copy_no_overlap(out + first, _data, (count - first) * sizeof(T));
+	}
+
+	void _copy_in(isize pos, T const* in, isize count){
+		isize start = pos & (_capacity - 1);
+		isize first = min(count, _capacity - start);
+		mem_copy_no_overlap(&_data[start], in, first * sizeof(T));
+		mem_copy_no_overlap(_data, in + first, (count - first) * sizeof(T));
+	}
+
+	// Make sure `count` elements fit, the contents are unwrapped into the new buffer
+	bool reserve(isize count){
+		if(count <= _capacity){ return true; }
+		isize new_cap = max<isize>(_capacity, 16);
+		while(new_cap < count){
+			new_cap *= 2;
+		}
+
+		auto [buf, error] = _allocator.alloc_non_zeroed(new_cap * sizeof(T), alignof(T));
+		if(!ok(error)){ return false; }
+
+		isize n = len();
+		if(_data != nullptr){
+			_copy_out((T*)buf, _head, n);
+			_allocator.free(_data, _capacity * sizeof(T), alignof(T));
+		}
+		_data = (T*)buf;
+		_capacity = new_cap;
+		_head = 0;
+		_tail = n;
+		return true;
+	}
+
+	bool push(T elem){
+		[[unlikely]] if(len() >= _capacity){
+			if(!reserve(max<isize>(_capacity * 2, 16))){ return false; }
+		}
+		_data[_tail & (_capacity - 1)] = elem;
+		_tail += 1;
+		return true;
+	}
+
+	bool push_slice(Slice<T> elems){
+		[[unlikely]] if(len() + elems.len() > _capacity){
+			if(!reserve(max<isize>(max<isize>(_capacity * 2, 16), len() + elems.len()))){ return false; }
+		}
+		_copy_in(_tail, elems.raw_data(), elems.len());
+		_tail += elems.len();
+		return true;
+	}
+
+	Pair<T, bool> pop(){
+		if(_head == _tail){ return {T{}, false}; }
+		T v = _data[_head & (_capacity - 1)];
+		_head += 1;
+		return {v, true};
+	}
+
+	// Pop up to out.len() elements into `out`, returns how many were popped
+	isize pop_slice(Slice<T> out){
+		isize n = min(out.len(), len());
+		if(n > 0){
+			_copy_out(out.raw_data(), _head, n);
+		}
+		_head += n;
+		return n;
+	}
+
+	void clear(){
+		_head = 0;
+		_tail = 0;
+	}
+
+	void destroy(){
+		_allocator.free(_data, _capacity * sizeof(T), alignof(T));
+		_data = nullptr;
+		_capacity = 0;
+		clear();
+	}
+
+	// `initial_cap` is rounded up to a power of two
+	static Pair<RingBuffer<T>, MemoryError> make(Allocator alloc, isize initial_cap = 16){
+		RingBuffer<T> rb = {
+			._data = nullptr,
+			._capacity = 0,
+			._head = 0,
+			._tail = 0,
+			._allocator = alloc,
+		};
+		if(!rb.reserve(initial_cap)){
+			return {rb, MemoryError::OutOfMemory};
+		}
+		return {rb, MemoryError::None};
+	}
+
+	// Accessors
+	isize len() const { return _tail - _head; }
+	isize cap() const { return _capacity; }
+	Allocator allocator() const { return _allocator; }
+};
+
+// Alignment of a queue allocated in one block together with its `Elem` storage
+template<typename Elem>
+constexpr isize queue_block_align(){
+	return isize(alignof(Elem)) > cache_line_size ? isize(alignof(Elem)) : cache_line_size;
+}
+
+// Fixed capacity, lock-free single producer/single consumer queue. Each side
+// owns one counter and keeps a cached copy of the other, so the shared cache
+// line is only read again when the queue looks full (or empty).
+template<typename T>
+struct SpscQueue {
+	// Consumer side
+	alignas(cache_line_size) Atomic<isize> _head;
+	isize _cached_tail;
+
+	// Producer side
+	alignas(cache_line_size) Atomic<isize> _tail;
+	isize _cached_head;
+
+	alignas(cache_line_size) T* _data;
+	isize     _capacity;
+	Allocator _allocator;
+
+	// Producer only. Push as many of `elems` as fit, returns how many were pushed.
+	isize push_slice(Slice<T> elems){
+		isize tail = _tail.load(std::memory_order_relaxed);
+		isize space = _capacity - (tail - _cached_head);
+		if(space < elems.len()){
+			_cached_head = _head.load(std::memory_order_acquire);
+			space = _capacity - (tail - _cached_head);
+		}
+
+		isize n = min(space, elems.len());
+		if(n <= 0){ return 0; }
+
+		isize start = tail & (_capacity - 1);
+		isize first = min(n, _capacity - start);
+		mem_copy_no_overlap(&_data[start], elems.raw_data(), first * sizeof(T));
+		mem_copy_no_overlap(_data, elems.raw_data() + first, (n - first) * sizeof(T));
+
+		_tail.store(tail + n, std::memory_order_release);
+		return n;
+	}
+
+	// Producer only
+	bool push(T elem){
+		isize tail = _tail.load(std::memory_order_relaxed);
+		if(tail - _cached_head >= _capacity){
+			_cached_head = _head.load(std::memory_order_acquire);
+			if(tail - _cached_head >= _capacity){ return false; }
+		}
+		_data[tail & (_capacity - 1)] = elem;
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Pop up to out.len() elements, returns how many were popped.
+	isize pop_slice(Slice<T> out){
+		isize head = _head.load(std::memory_order_relaxed);
+		isize avail = _cached_tail - head;
+		if(avail < out.len()){
+			_cached_tail = _tail.load(std::memory_order_acquire);
+			avail = _cached_tail - head;
+		}
+
+		isize n = min(avail, out.len());
+		if(n <= 0){ return 0; }
+
+		isize start = head & (_capacity - 1);
+		isize first = min(n, _capacity - start);
+		mem_copy_no_overlap(out.raw_data(), &_data[start], first * sizeof(T));
+		mem_copy_no_overlap(out.raw_data() + first, _data, (n - first) * sizeof(T));
+
+		_head.store(head + n, std::memory_order_release);
+		return n;
+	}
+
+	// Consumer only
+	Pair<T, bool> pop(){
+		isize head = _head.load(std::memory_order_relaxed);
+		if(head == _cached_tail){
+			_cached_tail = _tail.load(std::memory_order_acquire);
+			if(head == _cached_tail){ return {T{}, false}; }
+		}
+		T v = _data[head & (_capacity - 1)];
+		_head.store(head + 1, std::memory_order_release);
+		return {v, true};
+	}
+
+	// Frees the queue itself, no thread may be using it anymore
+	static isize _block_header(){
+		return mem_align_forward_size(sizeof(SpscQueue<T>), alignof(T));
+	}
+
+	void destroy(){
+		Allocator alloc = _allocator;
+		alloc.free(this, _block_header() + _capacity * sizeof(T), queue_block_align<T>());
+	}
+
+	// The queue is allocated together with its buffer since the atomics can't
+	// be moved. `capacity` is rounded up to a power of two.
+	static Pair<SpscQueue<T>*, MemoryError> make(Allocator alloc, isize capacity){
+		isize cap = 1;
+		while(cap < capacity){
+			cap *= 2;
+		}
+
+		isize header = _block_header();
+		auto [buf, error] = alloc.alloc_non_zeroed(header + cap * sizeof(T), queue_block_align<T>());
+		if(!ok(error)){
+			return {nullptr, error};
+		}
+
+		auto q = new (buf) SpscQueue<T>();
+		q->_head.store(0, std::memory_order_relaxed);
+		q->_tail.store(0, std::memory_order_relaxed);
+		q->_cached_tail = 0;
+		q->_cached_head = 0;
+		q->_data = (T*)((byte*)buf + header);
+		q->_capacity = cap;
+		q->_allocator = alloc;
+		return {q, MemoryError::None};
+	}
+
+	// Approximate when called while the other side is active
+	isize len() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+	isize cap() const { return _capacity; }
+};
+
+//// MPMC Queue ///////////////////////////////////////////////////////////////
+// Spins before a blocking queue operation sleeps on the cell it is waiting for
+constexpr isize mpmc_spin_count = 64;
+
+template<typename T>
+struct MpmcCell {
+	Atomic<isize> sequence; // Position the cell is ready for, +1 once it holds a value
+	T value;
+};
+
+// Bounded multi producer/multi consumer queue (Dmitry Vyukov's design). Every
+// cell has a sequence number telling whether it is ready to be written or read
+// for a given position, so producers and consumers only contend on their own
+// position counter.
+template<typename T>
+struct MpmcQueue {
+	alignas(cache_line_size) Atomic<isize> _enqueue_pos;
+	alignas(cache_line_size) Atomic<isize> _dequeue_pos;
+	alignas(cache_line_size) MpmcCell<T>* _cells;
+	isize     _capacity;
+	Allocator _allocator;
+
+	// Wait until `cell` reaches sequence `seq`
+	static void _wait_for(MpmcCell<T>* cell, isize seq){
+		for(isize i = 0; i < mpmc_spin_count; i += 1){
+			if(cell->sequence.load(std::memory_order_acquire) == seq){ return; }
+			spin_pause();
+		}
+		while(true){
+			isize cur = cell->sequence.load(std::memory_order_acquire);
+			if(cur == seq){ return; }
+			cell->sequence.wait(cur, std::memory_order_acquire);
+		}
+	}
+
+	static void _publish(MpmcCell<T>* cell, isize seq){
+		cell->sequence.store(seq, std::memory_order_release);
+		cell->sequence.notify_all();
+	}
+
+	// Returns false if the queue is full
+	bool try_push(T elem){
+		isize pos = _enqueue_pos.load(std::memory_order_relaxed);
+		while(true){
+			MpmcCell<T>* cell = &_cells[pos & (_capacity - 1)];
+			isize seq = cell->sequence.load(std::memory_order_acquire);
+			isize diff = seq - pos;
+			if(diff == 0){
+				if(_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+					cell->value = elem;
+					_publish(cell, pos + 1);
+					return true;
+				}
+			}
+			else if(diff < 0){
+				return false;
+			}
+			else {
+				pos = _enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Returns false if the queue is empty
+	Pair<T, bool> try_pop(){
+		isize pos = _dequeue_pos.load(std::memory_order_relaxed);
+		while(true){
+			MpmcCell<T>* cell = &_cells[pos & (_capacity - 1)];
+			isize seq = cell->sequence.load(std::memory_order_acquire);
+			isize diff = seq - (pos + 1);
+			if(diff == 0){
+				if(_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+					T v = cell->value;
+					_publish(cell, pos + _capacity);
+					return {v, true};
+				}
+			}
+			else if(diff < 0){
+				return {T{}, false};
+			}
+			else {
+				pos = _dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Pop up to out.len() elements that are ready in one claim, returns how many
+	// were popped
+	isize try_pop_slice(Slice<T> out){
+		if(out.len() == 0){ return 0; }
+		isize pos = _dequeue_pos.load(std::memory_order_relaxed);
+		while(true){
+			isize n = 0;
+			while(n < out.len()){
+				MpmcCell<T>* cell = &_cells[(pos + n) & (_capacity - 1)];
+				if(cell->sequence.load(std::memory_order_acquire) != pos + n + 1){ break; }
+				n += 1;
+			}
+
+			if(n == 0){
+				isize seq = _cells[pos & (_capacity - 1)].sequence.load(std::memory_order_acquire);
+				if(seq - (pos + 1) < 0){ return 0; }
+				pos = _dequeue_pos.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			if(_dequeue_pos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)){
+				for(isize i = 0; i < n; i += 1){
+					MpmcCell<T>* cell = &_cells[(pos + i) & (_capacity - 1)];
+					out[i] = cell->value;
+					_publish(cell, pos + i + _capacity);
+				}
+				return n;
+			}
+		}
+	}
+
+	// Claim a position and wait until there is room for it
+	void push(T elem){
+		isize pos = _enqueue_pos.fetch_add(1, std::memory_order_relaxed);
+		MpmcCell<T>* cell = &_cells[pos & (_capacity - 1)];
+		_wait_for(cell, pos);
+		cell->value = elem;
+		_publish(cell, pos + 1);
+	}
+
+	// Claim a position and wait until it has been filled
+	T pop(){
+		isize pos = _dequeue_pos.fetch_add(1, std::memory_order_relaxed);
+		MpmcCell<T>* cell = &_cells[pos & (_capacity - 1)];
+		_wait_for(cell, pos + 1);
+		T v = cell->value;
+		_publish(cell, pos + _capacity);
+		return v;
+	}
+
+	// Frees the queue itself, no thread may be using it anymore
+	static isize _block_header(){
+		return mem_align_forward_size(sizeof(MpmcQueue<T>), alignof(MpmcCell<T>));
+	}
+
+	void destroy(){
+		Allocator alloc = _allocator;
+		alloc.free(this, _block_header() + _capacity * sizeof(MpmcCell<T>), queue_block_align<MpmcCell<T>>());
+	}
+
+	// The queue is allocated together with its cells since the atomics can't be
+	// moved. `capacity` is rounded up to a power of two.
+	static Pair<MpmcQueue<T>*, MemoryError> make(Allocator alloc, isize capacity){
+		isize cap = 2;
+		while(cap < capacity){
+			cap *= 2;
+		}
+
+		isize header = _block_header();
+		auto [buf, error] = alloc.alloc_non_zeroed(header + cap * sizeof(MpmcCell<T>), queue_block_align<MpmcCell<T>>());
+		if(!ok(error)){
+			return {nullptr, error};
+		}
+
+		auto q = new (buf) MpmcQueue<T>();
+		q->_enqueue_pos.store(0, std::memory_order_relaxed);
+		q->_dequeue_pos.store(0, std::memory_order_relaxed);
+		q->_cells = (MpmcCell<T>*)((byte*)buf + header);
+		q->_capacity = cap;
+		q->_allocator = alloc;
+		for(isize i = 0; i < cap; i += 1){
+			auto cell = new (&q->_cells[i]) MpmcCell<T>();
+			cell->sequence.store(i, std::memory_order_relaxed);
+		}
+		return {q, MemoryError::None};
+	}
+
+	isize cap() const { return _capacity; }
+};
+
+//// SIMD /////////////////////////////////////////////////////////////////////
+namespace simd {
+#define VECTOR_DECL(T, N) __attribute__((vector_size((N) * sizeof(T)))) T;
+
+// 128-bit
+using i8x16 = VECTOR_DECL(i8, 16);
+using i16x8 = VECTOR_DECL(i16, 8);
+using i32x4 = VECTOR_DECL(i32, 4);
+using i64x2 = VECTOR_DECL(i64, 2);
+
+using u8x16 = VECTOR_DECL(u8, 16);
+using u16x8 = VECTOR_DECL(u16, 8);
+using u32x4 = VECTOR_DECL(u32, 4);
+using u64x2 = VECTOR_DECL(u64, 2);
+
+using f32x4 = VECTOR_DECL(f32, 4);
+using f64x2 = VECTOR_DECL(f64, 2);
+
+// 256-bit
+using i8x32  = VECTOR_DECL(i8, 32);
+using i16x16 = VECTOR_DECL(i16, 16);
+using i32x8  = VECTOR_DECL(i32, 8);
+using i64x4  = VECTOR_DECL(i64, 4);
+
+using u8x32  = VECTOR_DECL(u8, 32);
 using u16x16 = VECTOR_DECL(u16, 16);
 using u32x8  = VECTOR_DECL(u32, 8);
 using u64x4  = VECTOR_DECL(u64, 4);
 
-using f32x8 = VECTOR_DECL(f32, 8);
-using f64x4 = VECTOR_DECL(f64, 4);
+using f32x8 = VECTOR_DECL(f32, 8);
+using f64x4 = VECTOR_DECL(f64, 4);
+
+// Unaligned load
+static inline
+u8x16 load_u8x16(void const* p){
+	u8x16 v;
+	__builtin_memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline
+u8x16 splat_u8x16(u8 b){
+	return u8x16{} + b;
+}
+
+// Bit i of the result is the most significant bit of byte i
+static inline
+u32 movemask(u8x16 v){
+#if defined(__SSE2__)
+	using c8x16 = VECTOR_DECL(char, 16);
+	return u32(__builtin_ia32_pmovmskb128((c8x16)v));
+#else
+	u32 mask = 0;
+	for(i32 i = 0; i < 16; i += 1){
+		mask |= u32(v[i] >> 7) << i;
+	}
+	return mask;
+#endif
+}
+}
+
+//// Bit Set //////////////////////////////////////////////////////////////////
+// Word kernels shared by the bit sets, processing simd::u64x4 blocks
+void bits_or(u64* dst, u64 const* a, u64 const* b, isize nwords);
+
+void bits_and(u64* dst, u64 const* a, u64 const* b, isize nwords);
+
+void bits_and_not(u64* dst, u64 const* a, u64 const* b, isize nwords);
+
+isize bits_popcount(u64 const* words, isize nwords);
+
+// Index of the first set bit at or after `from`, -1 if there is none
+isize bits_find_next(u64 const* words, isize nwords, isize from);
+
+// Bit set with a size fixed at compile time. Bits past N are always 0.
+template<isize N>
+struct FixedBitSet {
+	static constexpr isize word_count = (N + 63) / 64;
+
+	u64 words[word_count];
+
+	bool test(isize idx) const {
+		bounds_check_assert(idx >= 0 && idx < N, "Out of bounds bit index");
+		return (words[idx >> 6] >> (idx & 63)) & 1;
+	}
+
+	void set(isize idx){
+		bounds_check_assert(idx >= 0 && idx < N, "Out of bounds bit index");
+		words[idx >> 6] |= u64(1) << (idx & 63);
+	}
+
+	void unset(isize idx){
+		bounds_check_assert(idx >= 0 && idx < N, "Out of bounds bit index");
+		words[idx >> 6] &= ~(u64(1) << (idx & 63));
+	}
+
+	void clear(){
+		mem_set(words, 0, sizeof(words));
+	}
+
+	isize count() const {
+		return bits_popcount(words, word_count);
+	}
+
+	// First set bit at or after `from`, -1 if none. Iterate with
+	// `for(isize i = s.next_set(0); i >= 0; i = s.next_set(i + 1))`
+	isize next_set(isize from) const {
+		return bits_find_next(words, word_count, from);
+	}
+
+	void union_with(FixedBitSet<N> const& other){
+		bits_or(words, words, other.words, word_count);
+	}
+
+	void intersect_with(FixedBitSet<N> const& other){
+		bits_and(words, words, other.words, word_count);
+	}
+
+	void difference_with(FixedBitSet<N> const& other){
+		bits_and_not(words, words, other.words, word_count);
+	}
+
+	static FixedBitSet<N> make(){
+		FixedBitSet<N> s;
+		s.clear();
+		return s;
+	}
+
+	// Accessors
+	isize len() const { return N; }
+};
+
+// Growable bit set, bits past the length are always 0.
+struct BitSet {
+	u64*      _words;
+	isize     _length; // In bits
+	Allocator _allocator;
+
+	bool test(isize idx) const {
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds bit index");
+		return (_words[idx >> 6] >> (idx & 63)) & 1;
+	}
+
+	void set(isize idx){
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds bit index");
+		_words[idx >> 6] |= u64(1) << (idx & 63);
+	}
+
+	void unset(isize idx){
+		bounds_check_assert(idx >= 0 && idx < _length, "Out of bounds bit index");
+		_words[idx >> 6] &= ~(u64(1) << (idx & 63));
+	}
+
+	void clear();
+
+	isize count() const;
+
+	// First set bit at or after `from`, -1 if none
+	isize next_set(isize from) const;
+
+	// The other set must have the same length
+	void union_with(BitSet const& other);
+
+	void intersect_with(BitSet const& other);
+
+	void difference_with(BitSet const& other);
+
+	// Change the number of bits, new bits start unset
+	bool resize(isize nbits);
+
+	void destroy();
+
+	static Pair<BitSet, MemoryError> make(Allocator alloc, isize nbits);
+
+	// Accessors
+	isize len() const { return _length; }
+	isize word_count() const { return (_length + 63) / 64; }
+	u64* raw_data() const { return _words; }
+	Allocator allocator() const { return _allocator; }
+};
+
+//// Hashing //////////////////////////////////////////////////////////////////
+// 64-bit finalizer (SplitMix64), good avalanche for integer keys
+static inline
+u64 hash_mix64(u64 x){
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+// XXH64 of a byte buffer
+u64 hash_bytes(void const* data, isize nbytes, u64 seed = 0);
+
+// Hash a value through its object bytes, keys of 1, 2, 4 or 8 bytes skip the
+// byte hash. Only valid when equal values have equal bytes, other key types
+// (e.g. structs with padding) need their own hash_value overload.
+template<typename T>
+u64 hash_value(T const& v, u64 seed = 0){
+	static_assert(std::has_unique_object_representations_v<T>,
+		"hash_value needs a dedicated overload for types whose equal values can differ in bytes");
+	if constexpr(sizeof(T) == 8){
+		u64 x; __builtin_memcpy(&x, &v, 8);
+		return hash_mix64(x ^ seed);
+	}
+	else if constexpr(sizeof(T) == 4){
+		u32 x; __builtin_memcpy(&x, &v, 4);
+		return hash_mix64(u64(x) ^ seed);
+	}
+	else if constexpr(sizeof(T) == 2){
+		u16 x; __builtin_memcpy(&x, &v, 2);
+		return hash_mix64(u64(x) ^ seed);
+	}
+	else if constexpr(sizeof(T) == 1){
+		u8 x; __builtin_memcpy(&x, &v, 1);
+		return hash_mix64(u64(x) ^ seed);
+	}
+	else {
+		return hash_bytes(&v, sizeof(T), seed);
+	}
+}
+
+// -0.0 and 0.0 compare equal so they have to hash the same
+static inline
+u64 hash_value(f32 v, u64 seed = 0){
+	u32 x; __builtin_memcpy(&x, &v, 4);
+	x = (v == 0) ? 0 : x;
+	return hash_mix64(u64(x) ^ seed);
+}
+
+static inline
+u64 hash_value(f64 v, u64 seed = 0){
+	u64 x; __builtin_memcpy(&x, &v, 8);
+	x = (v == 0) ? 0 : x;
+	return hash_mix64(x ^ seed);
+}
+
+static inline
+u64 hash_value(String s, u64 seed = 0){
+	return hash_bytes(s.raw_data(), s.len(), seed);
+}
+
+// Streaming XXH64, gives the same result as hash_bytes over the concatenated input
+struct Hasher {
+	u64   lanes[4];
+	u64   seed;
+	isize total_len;
+	byte  buffer[32];
+	isize buffered;
+
+	void update(void const* data, isize nbytes);
+
+	u64 finish() const;
+
+	static Hasher make(u64 seed = 0);
+};
+
+//// Map //////////////////////////////////////////////////////////////////////
+#include "debug_print.cpp"
+
+static inline
+u64 map_hash_fnv64(byte const * data, isize nbytes){
+	constexpr u64 prime = 0x100000001b3ull;
+	constexpr u64 offset_basis = 0xcbf29ce484222325ull;
+
+	u64 hash = offset_basis;
+	for(isize i = 0; i < nbytes; i ++){
+		auto b = u64(data[i]);
+		hash = hash ^ b;
+		hash = hash * prime;
+	}
+
+	return hash | u64(hash == 0);
+}
+
+static inline
+u64 map_hash(String key){
+	return hash_value(key);
+}
+
+template<typename K>
+u64 map_hash(K const& key){
+	return hash_value(key);
+}
+
+// Control byte of an empty slot, full slots store the top 7 bits of their hash
+constexpr u8    map_ctrl_empty  = 0x80;
+constexpr isize map_group_width = 16;
+
+template<typename K, typename V>
+struct MapSlot {
+	K   key;
+	V   value;
+	u64 hash;
+};
+
+// Open addressing hash map with linear probing. Control bytes are scanned 16 at
+// a time, removal shifts following entries back so there are no tombstones.
+template<typename K, typename V>
+struct Map {
+	MapSlot<K, V>* _slots;
+	u8*            _ctrl; // Capacity + group width bytes, the tail mirrors the start
+	isize          _capacity;
+	isize          _length;
+	Allocator      _allocator;
+
+	// Index of the slot holding key, -1 if not found
+	isize find(K const& key, u64 hash) const {
+		if(_capacity == 0){ return -1; }
+
+		isize mask = _capacity - 1;
+		isize pos  = isize(hash) & mask;
+		auto  h2   = simd::splat_u8x16(u8(hash >> 57));
+
+		while(true){
+			auto group = simd::load_u8x16(&_ctrl[pos]);
+			u32 empty  = simd::movemask(group);
+			u32 match  = simd::movemask((simd::u8x16)(group == h2));
+
+			// Entries past the first empty slot belong to other probe runs
+			if(empty != 0){
+				match &= (empty & -empty) - 1;
+			}
+
+			while(match != 0){
+				isize idx = (pos + __builtin_ctz(match)) & mask;
+				if(_slots[idx].hash == hash && _slots[idx].key == key){
+					return idx;
+				}
+				match &= match - 1;
+			}
+
+			if(empty != 0){ return -1; }
+			pos = (pos + map_group_width) & mask;
+		}
+	}
+
+	void _set_ctrl(isize idx, u8 ctrl){
+		_ctrl[idx] = ctrl;
+		if(idx < map_group_width){
+			_ctrl[_capacity + idx] = ctrl;
+		}
+	}
+
+	// Place an entry that is known to not be in the map yet
+	void _insert_new(K const& key, V const& value, u64 hash){
+		isize mask = _capacity - 1;
+		isize pos  = isize(hash) & mask;
+
+		while(true){
+			u32 empty = simd::movemask(simd::load_u8x16(&_ctrl[pos]));
+			if(empty != 0){
+				isize idx = (pos + __builtin_ctz(empty)) & mask;
+				_slots[idx] = MapSlot<K, V>{ .key = key, .value = value, .hash = hash };
+				_set_ctrl(idx, u8(hash >> 57));
+				_length += 1;
+				return;
+			}
+			pos = (pos + map_group_width) & mask;
+		}
+	}
+
+	Pair<V, bool> get(K const& key) const {
+		isize idx = find(key, map_hash(key));
+		if(idx < 0){ return {V{}, false}; }
+		return {_slots[idx].value, true};
+	}
+
+	// Pointer to the value, only valid until the map is modified
+	V* get_ptr(K const& key){
+		isize idx = find(key, map_hash(key));
+		if(idx < 0){ return nullptr; }
+		return &_slots[idx].value;
+	}
+
+	bool contains(K const& key) const {
+		return find(key, map_hash(key)) >= 0;
+	}
+
+	// Insert or update key, fails only if the map could not grow
+	bool set(K const& key, V const& value){
+		u64 hash = map_hash(key);
+		isize idx = find(key, hash);
+		if(idx >= 0){
+			_slots[idx].value = value;
+			return true;
+		}
+
+		// Keep load under 7/8, so every probe sequence ends at an empty slot
+		[[unlikely]] if((_length + 1) * 8 > _capacity * 7){
+			if(!reserve(_length + 1)){
+				return false;
+			}
+		}
+		_insert_new(key, value, hash);
+		return true;
+	}
+
+	bool remove(K const& key){
+		isize hole = find(key, map_hash(key));
+		if(hole < 0){ return false; }
+
+		isize mask = _capacity - 1;
+		isize j = hole;
+		while(true){
+			j = (j + 1) & mask;
+			if(_ctrl[j] == map_ctrl_empty){ break; }
+
+			// Entries whose home is cyclically in (hole, j] can't move before it
+			isize home = isize(_slots[j].hash) & mask;
+			bool stays = (hole <= j) ? (hole < home && home <= j)
+			                         : (hole < home || home <= j);
+			if(stays){ continue; }
+
+			_slots[hole] = _slots[j];
+			_set_ctrl(hole, _ctrl[j]);
+			hole = j;
+		}
+
+		_set_ctrl(hole, map_ctrl_empty);
+		_length -= 1;
+		return true;
+	}
+
+	// Make sure `count` entries fit without growing
+	bool reserve(isize count){
+		isize new_cap = map_group_width;
+		while(new_cap * 7 < count * 8){
+			new_cap *= 2;
+		}
+		if(new_cap <= _capacity){ return true; }
+
+		isize slots_size = mem_align_forward_size(new_cap * sizeof(MapSlot<K, V>), map_group_width);
+		isize nbytes = slots_size + new_cap + map_group_width;
+		isize align  = max<isize>(alignof(MapSlot<K, V>), map_group_width);
+		auto [buf, error] = _allocator.alloc_non_zeroed(nbytes, align);
+		if(!ok(error)){
+			return false;
+		}
+
+		MapSlot<K, V>* old_slots = _slots;
+		u8*   old_ctrl = _ctrl;
+		isize old_cap  = _capacity;
+
+		_slots = (MapSlot<K, V>*)buf;
+		_ctrl  = (u8*)buf + slots_size;
+		_capacity = new_cap;
+		_length = 0;
+		mem_set(_ctrl, map_ctrl_empty, new_cap + map_group_width);
+
+		for(isize i = 0; i < old_cap; i += 1){
+			if(old_ctrl[i] != map_ctrl_empty){
+				_insert_new(old_slots[i].key, old_slots[i].value, old_slots[i].hash);
+			}
+		}
+
+		if(old_slots != nullptr){
+			isize old_slots_size = mem_align_forward_size(old_cap * sizeof(MapSlot<K, V>), map_group_width);
+			_allocator.free(old_slots, old_slots_size + old_cap + map_group_width, align);
+		}
+		return true;
+	}
+
+	// Iterate over entries, `cursor` should start at 0
+	MapSlot<K, V>* iter_next(isize* cursor){
+		for(isize i = *cursor; i < _capacity; i += 1){
+			if(_ctrl[i] != map_ctrl_empty){
+				*cursor = i + 1;
+				return &_slots[i];
+			}
+		}
+		*cursor = _capacity;
+		return nullptr;
+	}
+
+	void clear(){
+		if(_capacity == 0){ return; }
+		mem_set(_ctrl, map_ctrl_empty, _capacity + map_group_width);
+		_length = 0;
+	}
+
+	void destroy(){
+		if(_slots == nullptr){ return; }
+		isize slots_size = mem_align_forward_size(_capacity * sizeof(MapSlot<K, V>), map_group_width);
+		isize align = max<isize>(alignof(MapSlot<K, V>), map_group_width);
+		_allocator.free(_slots, slots_size + _capacity + map_group_width, align);
+		_slots = nullptr;
+		_ctrl = nullptr;
+		_capacity = 0;
+		_length = 0;
+	}
+
+	static Pair<Map<K, V>, MemoryError> make(Allocator alloc, isize initial_cap = 16){
+		Map<K, V> m = {
+			._slots = nullptr,
+			._ctrl = nullptr,
+			._capacity = 0,
+			._length = 0,
+			._allocator = alloc,
+		};
+		if(!m.reserve(initial_cap)){
+			return {m, MemoryError::OutOfMemory};
+		}
+		return {m, MemoryError::None};
+	}
+
+	// Accessors
+	isize len() const { return _length; }
+	isize cap() const { return _capacity; }
+	Allocator allocator() const { return _allocator; }
+};
+
+//// Intern Pool //////////////////////////////////////////////////////////////
+// Handle to an interned string, two symbols are equal iff their strings are.
+// The zero symbol is the empty string.
+struct Symbol {
+	u32 id;
+
+	bool operator==(Symbol s) const { return id == s.id; }
+	bool operator!=(Symbol s) const { return id != s.id; }
+};
+
+// Deduplicated string storage. Bytes live contiguously in a chained arena so
+// interned strings never move, ids index into a table of those strings.
+struct InternPool {
+	Arena                _arena;
+	DynamicArray<String> _strings; // Indexed by symbol id
+	Map<String, u32>     _table;
+
+	// Symbol for `s`, copying it into the pool if it's not there yet
+	Result<Symbol, MemoryError> intern(String s);
+
+	// Intern every string in `strs`, storing the symbols in `out` (which must
+	// be at least as long). Space for all of them is reserved up front.
+	MemoryError intern_all(Slice<String> strs, Slice<Symbol> out);
+
+	// Symbol for `s` only if it was already interned
+	Pair<Symbol, bool> lookup(String s) const;
+
+	// String of a symbol, stays valid until the pool is destroyed
+	String get(Symbol sym) const;
+
+	void destroy();
+
+	static Pair<InternPool, MemoryError> make(Allocator alloc, isize block_size = 64 * mem_KiB);
+
+	// Accessors
+	isize len() const { return _strings.len(); }
+};
+
+//// Heap Allocator (LibC) ////////////////////////////////////////////////////
+Allocator heap_allocator();
+
+//// String Utilities /////////////////////////////////////////////////////////
+String str_trim(String s, String cutset);
+
+String str_trim_leading(String s, String cutset);
+
+String str_trim_trailing(String s, String cutset);
+
+isize str_rune_count(String s);
+
+bool str_starts_with(String s, String prefix);
+
+bool str_ends_with(String s, String suffix);
+
+// Lexicographic byte order, negative if a < b, 0 if equal, positive if a > b
+i32 str_compare(String a, String b);
+
+// Byte offset of the first occurrence of substr at or after start, -1 if not found
+isize str_find(String s, String substr, isize start = 0);
+
+// Byte offset of the last occurrence of substr, -1 if not found
+isize str_find_last(String s, String substr);
+
+// Finds non-overlapping occurrences of substr, storing as many offsets as fit
+// in positions. Returns the total number of occurrences, an empty substr has none.
+isize str_find_all(String s, String substr, Slice<isize> positions);
+
+[[nodiscard]]
+String str_clone(String s, Allocator allocator);
+
+[[nodiscard]]
+String str_concat(String s0, String s1, Allocator allocator);
+
+// Convert into a single buffer of exactly the right size, allocated from `a`.
+// Nothing stays allocated on error or when the output is empty.
+Pair<Slice<u16>, TranscodeResult> utf8_to_utf16(Slice<byte> src, Allocator a);
+
+Pair<Slice<rune>, TranscodeResult> utf8_to_utf32(Slice<byte> src, Allocator a);
+
+Pair<Slice<byte>, TranscodeResult> utf16_to_utf8(Slice<u16> src, Allocator a);
+
+Pair<Slice<byte>, TranscodeResult> utf32_to_utf8(Slice<rune> src, Allocator a);
+
+//// Sorting //////////////////////////////////////////////////////////////////
+constexpr isize sort_insertion_threshold     = 24;
+constexpr isize sort_ninther_threshold       = 128;
+constexpr isize sort_partial_insertion_limit = 8;
+// Below this many elements radix sorts fall back to comparison sorting
+constexpr isize radix_sort_threshold         = 64;
+
+template<typename T, typename Less>
+void _sort_insertion(T* begin, T* end, Less& less){
+	if(begin == end){ return; }
+	for(T* cur = begin + 1; cur != end; cur += 1){
+		T* sift = cur;
+		T* prev = cur - 1;
+		if(less(*sift, *prev)){
+			T tmp = *sift;
+			do { *sift-- = *prev; } while(sift != begin && less(tmp, *--prev));
+			*sift = tmp;
+		}
+	}
+}
+
+// Insertion sort for a range that has an element not greater than any of its
+// own right before it, so the inner loop needs no bounds check
+template<typename T, typename Less>
+void _sort_insertion_unguarded(T* begin, T* end, Less& less){
+	if(begin == end){ return; }
+	for(T* cur = begin + 1; cur != end; cur += 1){
+		T* sift = cur;
+		T* prev = cur - 1;
+		if(less(*sift, *prev)){
+			T tmp = *sift;
+			do { *sift-- = *prev; } while(less(tmp, *--prev));
+			*sift = tmp;
+		}
+	}
+}
+
+// Insertion sort that gives up after moving too many elements, returns
+// whether the range ended up sorted
+template<typename T, typename Less>
+bool _sort_insertion_partial(T* begin, T* end, Less& less){
+	if(begin == end){ return true; }
+	isize moved = 0;
+	for(T* cur = begin + 1; cur != end; cur += 1){
+		T* sift = cur;
+		T* prev = cur - 1;
+		if(less(*sift, *prev)){
+			T tmp = *sift;
+			do { *sift-- = *prev; } while(sift != begin && less(tmp, *--prev));
+			*sift = tmp;
+			moved += cur - sift;
+		}
+		if(moved > sort_partial_insertion_limit){ return false; }
+	}
+	return true;
+}
+
+template<typename T, typename Less>
+void _sort3(T* a, T* b, T* c, Less& less){
+	if(less(*b, *a)){ swap(a, b); }
+	if(less(*c, *b)){ swap(b, c); }
+	if(less(*b, *a)){ swap(a, b); }
+}
+
+template<typename T, typename Less>
+void _sort_heap(T* begin, T* end, Less& less){
+	isize n = end - begin;
+	auto sift_down = [&](isize i, isize len){
+		while(true){
+			isize child = 2 * i + 1;
+			if(child >= len){ break; }
+			if(child + 1 < len && less(begin[child], begin[child + 1])){ child += 1; }
+			if(!less(begin[i], begin[child])){ break; }
+			swap(&begin[i], &begin[child]);
+			i = child;
+		}
+	};
+	for(isize i = n / 2 - 1; i >= 0; i -= 1){
+		sift_down(i, n);
+	}
+	for(isize i = n - 1; i > 0; i -= 1){
+		swap(&begin[0], &begin[i]);
+		sift_down(0, i);
+	}
+}
+
+// Partition around *begin, elements equal to the pivot go to the right.
+// Returns the pivot's final position and whether nothing had to be swapped.
+template<typename T, typename Less>
+Pair<T*, bool> _sort_partition_right(T* begin, T* end, Less& less){
+	T pivot = *begin;
+	T* first = begin;
+	T* last  = end;
+
+	while(less(*++first, pivot));
+	if(first - 1 == begin){
+		while(first < last && !less(*--last, pivot));
+	}
+	else {
+		while(!less(*--last, pivot));
+	}
+
+	bool already_partitioned = first >= last;
+	while(first < last){
+		swap(first, last);
+		while(less(*++first, pivot));
+		while(!less(*--last, pivot));
+	}
+
+	T* pivot_pos = first - 1;
+	*begin = *pivot_pos;
+	*pivot_pos = pivot;
+	return {pivot_pos, already_partitioned};
+}
+
+// Partition around *begin, elements equal to the pivot go to the left. Used
+// when the pivot equals the element before the range, so the whole left side
+// is equal and needs no further sorting.
+template<typename T, typename Less>
+T* _sort_partition_left(T* begin, T* end, Less& less){
+	T pivot = *begin;
+	T* first = begin;
+	T* last  = end;
+
+	while(less(pivot, *--last));
+	if(last + 1 == end){
+		while(first < last && !less(pivot, *++first));
+	}
+	else {
+		while(!less(pivot, *++first));
+	}
+
+	while(first < last){
+		swap(first, last);
+		while(less(pivot, *--last));
+		while(!less(pivot, *++first));
+	}
+
+	T* pivot_pos = last;
+	*begin = *pivot_pos;
+	*pivot_pos = pivot;
+	return pivot_pos;
+}
+
+template<typename T, typename Less>
+void _sort_pdq(T* begin, T* end, Less& less, i32 bad_allowed, bool leftmost){
+	while(true){
+		isize size = end - begin;
+		if(size < sort_insertion_threshold){
+			if(leftmost){ _sort_insertion(begin, end, less); }
+			else        { _sort_insertion_unguarded(begin, end, less); }
+			return;
+		}
+
+		// Median of 3, or pseudo median of 9 for larger ranges, moved to *begin
+		isize half = size / 2;
+		if(size > sort_ninther_threshold){
+			_sort3(begin, begin + half, end - 1, less);
+			_sort3(begin + 1, begin + (half - 1), end - 2, less);
+			_sort3(begin + 2, begin + (half + 1), end - 3, less);
+			_sort3(begin + (half - 1), begin + half, begin + (half + 1), less);
+			swap(begin, begin + half);
+		}
+		else {
+			_sort3(begin + half, begin, end - 1, less);
+		}
+
+		// Lots of elements equal to the pivot, skip over them all at once
+		if(!leftmost && !less(*(begin - 1), *begin)){
+			begin = _sort_partition_left(begin, end, less) + 1;
+			continue;
+		}
+
+		auto [pivot_pos, already_partitioned] = _sort_partition_right(begin, end, less);
+		isize l_size = pivot_pos - begin;
+		isize r_size = end - (pivot_pos + 1);
+
+		if(l_size < size / 8 || r_size < size / 8){
+			// Too many bad pivots, switch to a guaranteed O(n log n) sort
+			bad_allowed -= 1;
+			if(bad_allowed == 0){
+				_sort_heap(begin, end, less);
+				return;
+			}
+
+			// Break up patterns that may be causing the bad pivots
+			if(l_size >= sort_insertion_threshold){
+				swap(begin, begin + l_size / 4);
+				swap(pivot_pos - 1, pivot_pos - l_size / 4);
+				if(l_size > sort_ninther_threshold){
+					swap(begin + 1, begin + (l_size / 4 + 1));
+					swap(begin + 2, begin + (l_size / 4 + 2));
+					swap(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+					swap(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+				}
+			}
+			if(r_size >= sort_insertion_threshold){
+				swap(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
+				swap(end - 1, end - r_size / 4);
+				if(r_size > sort_ninther_threshold){
+					swap(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
+					swap(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
+					swap(end - 2, end - (1 + r_size / 4));
+					swap(end - 3, end - (2 + r_size / 4));
+				}
+			}
+		}
+		else if(already_partitioned
+			&& _sort_insertion_partial(begin, pivot_pos, less)
+			&& _sort_insertion_partial(pivot_pos + 1, end, less)){
+			// Input looked sorted and it was
+			return;
+		}
+
+		// Recurse into the left side, loop on the right one
+		_sort_pdq(begin, pivot_pos, less, bad_allowed, leftmost);
+		begin = pivot_pos + 1;
+		leftmost = false;
+	}
+}
+
+// Unstable in-place sort (pattern-defeating quicksort). O(n log n) worst case,
+// linear on sorted, reversed and many-equal inputs.
+template<typename T, typename Less>
+void sort(Slice<T> s, Less less){
+	isize n = s.len();
+	if(n < 2){ return; }
+	i32 log2n = 63 - __builtin_clzll(u64(n));
+	_sort_pdq(s.raw_data(), s.raw_data() + n, less, log2n, true);
+}
+
+template<typename T>
+void sort(Slice<T> s){
+	sort(s, [](T const& a, T const& b){ return a < b; });
+}
+
+static inline
+void sort(Slice<String> s){
+	sort(s, [](String a, String b){ return str_compare(a, b) < 0; });
+}
+
+// Stable LSD radix sorts, byte at a time, with `scratch` providing a buffer as
+// large as the input. Digits that are the same for every key are skipped.
+// Floats are ordered by their IEEE total order (-NaN < -inf < ... < inf < NaN).
+MemoryError radix_sort(Slice<u32> s, Allocator scratch);
+MemoryError radix_sort(Slice<u64> s, Allocator scratch);
+MemoryError radix_sort(Slice<i32> s, Allocator scratch);
+MemoryError radix_sort(Slice<i64> s, Allocator scratch);
+MemoryError radix_sort(Slice<f32> s, Allocator scratch);
+MemoryError radix_sort(Slice<f64> s, Allocator scratch);
+
+// Strings are sorted most significant byte first, since their lengths vary
+MemoryError radix_sort(Slice<String> s, Allocator scratch);
+
+// Index of the first element not less than `key`, or s.len() if there is none.
+// The loop has a fixed trip count for a given length and no branches on the
+// comparison, so it does not suffer from mispredictions.
+template<typename T, typename K>
+isize lower_bound(Slice<T> s, K const& key){
+	isize n = s.len();
+	if(n == 0){ return 0; }
+
+	T const* base = s.raw_data();
+	while(n > 1){
+		isize half = n / 2;
+		base = (base[half] < key) ? base + half : base;
+		n -= half;
+	}
+	return (base - s.raw_data()) + isize(*base < key);
+}
+
+// Index of an element equal to `key` in sorted `s`, -1 if not found
+template<typename T, typename K>
+isize binary_search(Slice<T> s, K const& key){
+	isize idx = lower_bound(s, key);
+	if(idx < s.len() && s[idx] == key){ return idx; }
+	return -1;
+}
+
+template<typename T>
+isize _eytzinger_fill(T const* sorted, T* out, isize n, isize i, isize k){
+	if(k <= n){
+		i = _eytzinger_fill(sorted, out, n, i, 2 * k);
+		out[k - 1] = sorted[i];
+		i += 1;
+		i = _eytzinger_fill(sorted, out, n, i, 2 * k + 1);
+	}
+	return i;
+}
+
+// Store sorted `sorted` in Eytzinger (breadth first tree) order into `out`, which
+// must have the same length. Searches then touch memory in a predictable pattern
+// the next levels of which can be prefetched.
+template<typename T>
+void eytzinger_build(Slice<T> sorted, Slice<T> out){
+	bounds_check_assert(out.len() == sorted.len(), "Eytzinger output must be as long as the input");
+	_eytzinger_fill(sorted.raw_data(), out.raw_data(), sorted.len(), 0, 1);
 }
 
+// Index into `eyt` of the first element not less than `key`, -1 if there is none
+template<typename T, typename K>
+isize eytzinger_lower_bound(Slice<T> eyt, K const& key){
+	T const* data = eyt.raw_data();
+	isize n = eyt.len();
+	isize k = 1;
+	constexpr isize lookahead = isize(sizeof(T)) >= cache_line_size ? 1 : cache_line_size / isize(sizeof(T));
+	while(k <= n){
+		__builtin_prefetch(data + (k * lookahead - 1));
+		k = 2 * k + isize(data[k - 1] < key);
+	}
+	// Undo the right turns taken after the last left one
+	k >>= __builtin_ffsll(~k);
+	return k - 1;
+}
+
+//// String Builder ///////////////////////////////////////////////////////////
+// struct StringBuilder {
+// 	DynamicArray<byte> buffer;
+// };
+//
+// StringBuilder str_builder_create(Allocator allocator);
+//
+// void str_append(StringBuilder* sb, String v);
+// void str_append(StringBuilder* sb, rune v);
+// void str_append(StringBuilder* sb, i64 v);
+// void str_append(StringBuilder* sb, f64 v);
+// void str_append(StringBuilder* sb, bool v);
+
 #endif /* Include guard */
@@ -0,0 +1,85 @@
+// Compares str_find against libc memmem, build and run with `./build.sh bench`
+#include "base.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+constexpr isize haystack_size = 16 * mem_MiB;
+constexpr i32 bench_rounds = 5;
+
+static
+f64 now_seconds(){
+	using namespace std::chrono;
+	return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Count every (overlapping) occurrence, so matches are verified as well as skipped
+static
+isize count_str_find(String s, String needle){
+	isize count = 0;
+	for(isize pos = str_find(s, needle); pos >= 0; pos = str_find(s, needle, pos + 1)){
+		count += 1;
+	}
+	return count;
+}
+
+static
+isize count_memmem(String s, String needle){
+	isize count = 0;
+	byte const* base = s.raw_data();
+	byte const* end  = base + s.len();
+	byte const* p = base;
+	while((p = (byte const*)memmem(p, end - p, needle.raw_data(), needle.len())) != nullptr){
+		count += 1;
+		p += 1;
+	}
+	return count;
+}
+
+// Best of `bench_rounds`, in GB/s
+template<typename Func>
+f64 throughput(Func f, String s, String needle, isize* count){
+	f64 best = 0;
+	for(i32 r = 0; r < bench_rounds; r += 1){
+		f64 start = now_seconds();
+		*count = f(s, needle);
+		f64 elapsed = now_seconds() - start;
+		best = max(best, f64(s.len()) / elapsed / 1e9);
+	}
+	return best;
+}
+
+int main(){
+	auto [buf, error] = heap_allocator().alloc_non_zeroed(haystack_size, 1);
+	ensure(ok(error), "Failed to allocate haystack");
+	defer(heap_allocator().free(buf, haystack_size, 1));
+
+	// Random lowercase text, a small alphabet keeps the prefilter and Horspool honest
+	byte* data = (byte*)buf;
+	u64 state = 0x9e3779b97f4a7c15;
+	for(isize i = 0; i < haystack_size; i += 1){
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		data[i] = byte('a' + (state >> 59) % 26);
+	}
+	String haystack = String(data, haystack_size);
+
+	struct Case { char const* name; String needle; };
+	Case cases[] = {
+		{"1 byte",              "q"},
+		{"2 bytes",             "zq"},
+		{"9 bytes (prefilter)", "xylophone"},
+		{"32 bytes (prefilter)", "thequickbrownfoxjumpsoverthelazy"},
+		{"60 bytes (horspool)", "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefgh"},
+		{"in haystack (horspool)", String(&data[haystack_size / 2], 48)},
+	};
+
+	printf("%-24s %12s %12s %10s\n", "needle", "str_find", "memmem", "matches");
+	for(Case const& c : cases){
+		isize found = 0, expected = 0;
+		f64 ours   = throughput(count_str_find, haystack, c.needle, &found);
+		f64 theirs = throughput(count_memmem, haystack, c.needle, &expected);
+		ensure(found == expected, "str_find and memmem disagree");
+		printf("%-24s %7.2f GB/s %7.2f GB/s %10ld\n", c.name, ours, theirs, long(found));
+	}
+	return 0;
+}
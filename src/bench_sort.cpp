@@ -0,0 +1,149 @@
+// Compares sort and radix_sort against std::sort, and lower_bound against
+// eytzinger_lower_bound. Build and run with `./build.sh bench`
+#include "base.hpp"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+constexpr isize element_count = 1'000'000;
+constexpr isize string_count  = 200'000;
+constexpr isize query_count   = 1'000'000;
+constexpr i32 bench_rounds = 3;
+
+static
+f64 now_seconds(){
+	using namespace std::chrono;
+	return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+static u64 rng_state = 0x9e3779b97f4a7c15;
+
+static
+u64 rng_next(){
+	rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+	return hash_mix64(rng_state);
+}
+
+template<typename T>
+void free_slice(Allocator a, Slice<T> s){
+	a.free(s.raw_data(), s.len() * sizeof(T), alignof(T));
+}
+
+// Best of `bench_rounds` in milliseconds, each round sorts a fresh copy of `input` into `out`
+template<typename T, typename Func>
+f64 time_sort(Slice<T> input, Slice<T> out, Func f){
+	f64 best = 1e30;
+	for(i32 r = 0; r < bench_rounds; r += 1){
+		mem_copy_no_overlap(out.raw_data(), input.raw_data(), input.len() * sizeof(T));
+		f64 start = now_seconds();
+		f(out);
+		best = min(best, (now_seconds() - start) * 1e3);
+	}
+	return best;
+}
+
+template<typename T, typename Less>
+void bench_sorts(char const* name, Slice<T> input, Less less){
+	Allocator heap = heap_allocator();
+	isize n = input.len();
+	auto expected = make<T>(heap, n);
+	auto ours     = make<T>(heap, n);
+	auto radix    = make<T>(heap, n);
+	defer(free_slice(heap, expected));
+	defer(free_slice(heap, ours));
+	defer(free_slice(heap, radix));
+
+	f64 std_ms = time_sort(input, expected, [&](Slice<T> s){ std::sort(s.raw_data(), s.raw_data() + s.len(), less); });
+	f64 pdq_ms = time_sort(input, ours, [&](Slice<T> s){ sort(s, less); });
+	f64 radix_ms = time_sort(input, radix, [&](Slice<T> s){
+		ensure(ok(radix_sort(s, heap)), "Failed to allocate radix sort scratch");
+	});
+
+	for(isize i = 0; i < n; i += 1){
+		ensure(!less(ours[i], expected[i]) && !less(expected[i], ours[i]), "sort and std::sort disagree");
+		ensure(!less(radix[i], expected[i]) && !less(expected[i], radix[i]), "radix_sort and std::sort disagree");
+	}
+	printf("%-8s %9.2f ms %9.2f ms %9.2f ms\n", name, std_ms, pdq_ms, radix_ms);
+}
+
+static
+void bench_search(){
+	Allocator heap = heap_allocator();
+	auto sorted  = make<u64>(heap, element_count);
+	auto eyt     = make<u64>(heap, element_count);
+	auto queries = make<u64>(heap, query_count);
+	defer(free_slice(heap, sorted));
+	defer(free_slice(heap, eyt));
+	defer(free_slice(heap, queries));
+
+	for(isize i = 0; i < element_count; i += 1){ sorted[i] = rng_next(); }
+	sort(sorted);
+	eytzinger_build(sorted, eyt);
+	for(isize i = 0; i < query_count; i += 1){ queries[i] = rng_next(); }
+
+	// Sum of found values, both searches must agree on it
+	u64 sum_lower = 0, sum_eyt = 0;
+	f64 lower_ms = 1e30, eyt_ms = 1e30;
+	for(i32 r = 0; r < bench_rounds; r += 1){
+		f64 start = now_seconds();
+		u64 sum = 0;
+		for(isize i = 0; i < query_count; i += 1){
+			isize idx = lower_bound(sorted, queries[i]);
+			sum += (idx < element_count) ? sorted[idx] : 0;
+		}
+		lower_ms = min(lower_ms, (now_seconds() - start) * 1e3);
+		sum_lower = sum;
+
+		start = now_seconds();
+		sum = 0;
+		for(isize i = 0; i < query_count; i += 1){
+			isize idx = eytzinger_lower_bound(eyt, queries[i]);
+			sum += (idx >= 0) ? eyt[idx] : 0;
+		}
+		eyt_ms = min(eyt_ms, (now_seconds() - start) * 1e3);
+		sum_eyt = sum;
+	}
+	ensure(sum_lower == sum_eyt, "lower_bound and eytzinger_lower_bound disagree");
+
+	printf("\n%-22s %9s\n", "search (1M u64)", "1M queries");
+	printf("%-22s %9.2f ms\n", "lower_bound", lower_ms);
+	printf("%-22s %9.2f ms\n", "eytzinger_lower_bound", eyt_ms);
+}
+
+int main(){
+	Allocator heap = heap_allocator();
+
+	printf("%-8s %12s %12s %12s\n", "input", "std::sort", "sort", "radix_sort");
+
+	/* u64 */ {
+		auto input = make<u64>(heap, element_count);
+		defer(free_slice(heap, input));
+		for(isize i = 0; i < element_count; i += 1){ input[i] = rng_next(); }
+		bench_sorts("u64", input, [](u64 a, u64 b){ return a < b; });
+	}
+
+	/* f64, finite values of both signs so IEEE total order matches operator< */ {
+		auto input = make<f64>(heap, element_count);
+		defer(free_slice(heap, input));
+		for(isize i = 0; i < element_count; i += 1){ input[i] = (f64(rng_next() >> 11) - f64(1ull << 52)) * 1e-3; }
+		bench_sorts("f64", input, [](f64 a, f64 b){ return a < b; });
+	}
+
+	/* String, 4 to 35 lowercase bytes sharing a pool */ {
+		constexpr isize pool_size = 4 * mem_MiB;
+		auto pool  = make<byte>(heap, pool_size);
+		auto input = make<String>(heap, string_count);
+		defer(free_slice(heap, pool));
+		defer(free_slice(heap, input));
+		for(isize i = 0; i < pool_size; i += 1){ pool[i] = byte('a' + rng_next() % 26); }
+		for(isize i = 0; i < string_count; i += 1){
+			isize len = 4 + isize(rng_next() % 32);
+			isize offset = isize(rng_next() % u64(pool_size - len));
+			input[i] = String(&pool[offset], len);
+		}
+		bench_sorts("String", input, [](String a, String b){ return str_compare(a, b) < 0; });
+	}
+
+	bench_search();
+	return 0;
+}
@@ -0,0 +1,109 @@
+// Times the UTF-8 <-> UTF-16/UTF-32 transcoders on text of different scripts.
+// Build and run with `./build.sh bench`
+#include "base.hpp"
+#include <stdio.h>
+#include <chrono>
+
+constexpr isize text_size = 16 * mem_MiB;
+constexpr i32 bench_rounds = 5;
+
+static
+f64 now_seconds(){
+	using namespace std::chrono;
+	return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+static u64 rng_state = 0x9e3779b97f4a7c15;
+
+static
+u64 rng_next(){
+	rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+	return hash_mix64(rng_state);
+}
+
+template<typename T>
+Slice<T> alloc_slice(isize n){
+	auto [p, error] = heap_allocator().alloc_non_zeroed(max<isize>(n, 1) * sizeof(T), alignof(T));
+	ensure(ok(error), "Failed to allocate benchmark buffer");
+	return Slice<T>((T*)p, n);
+}
+
+template<typename T>
+void free_slice(Slice<T> s){
+	heap_allocator().free(s.raw_data(), max<isize>(s.len(), 1) * sizeof(T), alignof(T));
+}
+
+// Code points in [lo, hi), with `space_every` ASCII spaces mixed in like word breaks
+struct Script {
+	char const* name;
+	rune lo, hi;
+	i32 space_every;
+};
+
+static
+Slice<byte> make_text(Script script){
+	auto text = alloc_slice<byte>(text_size);
+	isize n = 0;
+	while(true){
+		rune r = (script.space_every > 0 && rng_next() % script.space_every == 0)
+			? ' '
+			: rune(script.lo + rng_next() % u64(script.hi - script.lo));
+		auto enc = utf8_encode(r);
+		if(enc.len == 0){ continue; }
+		if(n + enc.len > text_size){ break; }
+		for(i32 k = 0; k < enc.len; k += 1){
+			text[n + k] = enc.bytes[k];
+		}
+		n += enc.len;
+	}
+	return Slice<byte>(text.raw_data(), n);
+}
+
+// Best of `bench_rounds`, in GB/s of UTF-8
+template<typename Func>
+f64 throughput(isize utf8_bytes, Func f){
+	f64 best = 0;
+	for(i32 r = 0; r < bench_rounds; r += 1){
+		f64 start = now_seconds();
+		TranscodeResult res = f();
+		f64 elapsed = now_seconds() - start;
+		ensure(res.error == TranscodeError::None, "Transcoding failed");
+		best = max(best, f64(utf8_bytes) / elapsed / 1e9);
+	}
+	return best;
+}
+
+int main(){
+	Script scripts[] = {
+		{"ASCII",    0x20,    0x7f,    0},
+		{"Latin-1",  0x20,    0x100,   0},
+		{"Cyrillic", 0x410,   0x450,   6},
+		{"CJK",      0x4e00,  0x9fff,  0},
+		{"Emoji",    0x1f300, 0x1f650, 4},
+	};
+
+	printf("%-10s %13s %13s %13s %13s\n", "GB/s", "utf8->utf16", "utf16->utf8", "utf8->utf32", "utf32->utf8");
+	for(Script const& script : scripts){
+		auto text = make_text(script);
+		isize n = text.len();
+		auto u16s  = alloc_slice<u16>(utf16_length_from_utf8(text));
+		auto u32s  = alloc_slice<rune>(utf8_rune_count(text));
+		auto back8 = alloc_slice<byte>(n);
+
+		f64 to16 = throughput(n, [&]{ return utf8_to_utf16(text, u16s); });
+		f64 from16 = throughput(n, [&]{ return utf16_to_utf8(u16s, back8); });
+		ensure(mem_compare(back8.raw_data(), text.raw_data(), n) == 0, "UTF-16 round trip mismatch");
+
+		f64 to32 = throughput(n, [&]{ return utf8_to_utf32(text, u32s); });
+		f64 from32 = throughput(n, [&]{ return utf32_to_utf8(u32s, back8); });
+		ensure(mem_compare(back8.raw_data(), text.raw_data(), n) == 0, "UTF-32 round trip mismatch");
+
+		printf("%-10s %13.2f %13.2f %13.2f %13.2f\n", script.name, to16, from16, to32, from32);
+
+		free_slice(back8);
+		free_slice(u32s);
+		free_slice(u16s);
+		heap_allocator().free(text.raw_data(), text_size, 1);
+	}
+	return 0;
+}
@@ -0,0 +1,179 @@
+#include "base.hpp"
+
+using simd::u64x4;
+
+constexpr isize bits_block_words = 4;
+
+// Vectors are passed by pointer, passing 256-bit values changes the ABI
+// depending on whether AVX is enabled
+static inline
+void load_u64x4(u64x4* v, u64 const* p){
+	__builtin_memcpy(v, p, sizeof(*v));
+}
+
+static inline
+void store_u64x4(u64* p, u64x4 const* v){
+	__builtin_memcpy(p, v, sizeof(*v));
+}
+
+void bits_or(u64* dst, u64 const* a, u64 const* b, isize nwords){
+	isize i = 0;
+	for(; i + bits_block_words <= nwords; i += bits_block_words){
+		u64x4 va, vb;
+		load_u64x4(&va, &a[i]);
+		load_u64x4(&vb, &b[i]);
+		u64x4 r = va | vb;
+		store_u64x4(&dst[i], &r);
+	}
+	for(; i < nwords; i += 1){
+		dst[i] = a[i] | b[i];
+	}
+}
+
+void bits_and(u64* dst, u64 const* a, u64 const* b, isize nwords){
+	isize i = 0;
+	for(; i + bits_block_words <= nwords; i += bits_block_words){
+		u64x4 va, vb;
+		load_u64x4(&va, &a[i]);
+		load_u64x4(&vb, &b[i]);
+		u64x4 r = va & vb;
+		store_u64x4(&dst[i], &r);
+	}
+	for(; i < nwords; i += 1){
+		dst[i] = a[i] & b[i];
+	}
+}
+
+void bits_and_not(u64* dst, u64 const* a, u64 const* b, isize nwords){
+	isize i = 0;
+	for(; i + bits_block_words <= nwords; i += bits_block_words){
+		u64x4 va, vb;
+		load_u64x4(&va, &a[i]);
+		load_u64x4(&vb, &b[i]);
+		u64x4 r = va & ~vb;
+		store_u64x4(&dst[i], &r);
+	}
+	for(; i < nwords; i += 1){
+		dst[i] = a[i] & ~b[i];
+	}
+}
+
+isize bits_popcount(u64 const* words, isize nwords){
+	// Independent accumulators so the popcounts don't form one dependency chain
+	isize c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+	isize i = 0;
+	for(; i + bits_block_words <= nwords; i += bits_block_words){
+		c0 += __builtin_popcountll(words[i + 0]);
+		c1 += __builtin_popcountll(words[i + 1]);
+		c2 += __builtin_popcountll(words[i + 2]);
+		c3 += __builtin_popcountll(words[i + 3]);
+	}
+	for(; i < nwords; i += 1){
+		c0 += __builtin_popcountll(words[i]);
+	}
+	return c0 + c1 + c2 + c3;
+}
+
+isize bits_find_next(u64 const* words, isize nwords, isize from){
+	isize w = from >> 6;
+	if(from < 0 || w >= nwords){ return -1; }
+
+	u64 first = words[w] & (~u64(0) << (from & 63));
+	if(first != 0){
+		return (w << 6) + __builtin_ctzll(first);
+	}
+	w += 1;
+
+	// Skip empty blocks four words at a time
+	for(; w + bits_block_words <= nwords; w += bits_block_words){
+		u64x4 v;
+		load_u64x4(&v, &words[w]);
+		if((v[0] | v[1] | v[2] | v[3]) != 0){
+			break;
+		}
+	}
+
+	for(; w < nwords; w += 1){
+		if(words[w] != 0){
+			return (w << 6) + __builtin_ctzll(words[w]);
+		}
+	}
+	return -1;
+}
+
+void BitSet::clear(){
+	mem_set(_words, 0, word_count() * sizeof(u64));
+}
+
+isize BitSet::count() const {
+	return bits_popcount(_words, word_count());
+}
+
+isize BitSet::next_set(isize from) const {
+	return bits_find_next(_words, word_count(), from);
+}
+
+void BitSet::union_with(BitSet const& other){
+	bounds_check_assert(other._length == _length, "Bit set lengths differ");
+	bits_or(_words, _words, other._words, word_count());
+}
+
+void BitSet::intersect_with(BitSet const& other){
+	bounds_check_assert(other._length == _length, "Bit set lengths differ");
+	bits_and(_words, _words, other._words, word_count());
+}
+
+void BitSet::difference_with(BitSet const& other){
+	bounds_check_assert(other._length == _length, "Bit set lengths differ");
+	bits_and_not(_words, _words, other._words, word_count());
+}
+
+bool BitSet::resize(isize nbits){
+	isize old_words = word_count();
+	isize new_words = (nbits + 63) / 64;
+
+	if(new_words != old_words){
+		Result<void*, MemoryError> res = {};
+		if(_words == nullptr){
+			res = _allocator.alloc(new_words * sizeof(u64), alignof(u64));
+		}
+		else {
+			res = _allocator.realloc(_words, old_words * sizeof(u64), new_words * sizeof(u64), alignof(u64));
+		}
+		if(!ok(res)){
+			return false;
+		}
+		_words = (u64*)res.value;
+	}
+
+	// Bits between the old and new length (or past the new one) must read as 0
+	isize keep = min(_length, nbits);
+	if(keep & 63){
+		_words[keep >> 6] &= (u64(1) << (keep & 63)) - 1;
+	}
+	isize zero_from = (keep + 63) / 64;
+	if(new_words > zero_from){
+		mem_set(&_words[zero_from], 0, (new_words - zero_from) * sizeof(u64));
+	}
+
+	_length = nbits;
+	return true;
+}
+
+void BitSet::destroy(){
+	_allocator.free(_words, word_count() * sizeof(u64), alignof(u64));
+	_words = nullptr;
+	_length = 0;
+}
+
+Pair<BitSet, MemoryError> BitSet::make(Allocator alloc, isize nbits){
+	BitSet s = {
+		._words = nullptr,
+		._length = 0,
+		._allocator = alloc,
+	};
+	if(!s.resize(nbits)){
+		return {s, MemoryError::OutOfMemory};
+	}
+	return {s, MemoryError::None};
+}
@@ -6,7 +6,7 @@ cflags='-std=c++20 -Wall -Wextra'
 buildMode="$1"
 
 case "$buildMode" in
-	'release') cflags="$cflags -DRELEASE_MODE -O3";;
+	'release'|'bench') cflags="$cflags -DRELEASE_MODE -O3";;
 	*)         cflags="$cflags -O0 -g" ;;
 esac
 
@@ -14,6 +14,16 @@ set -eu
 
 Run(){ echo "$@"; $@; }
 
+if [ "$buildMode" = 'bench' ]; then
+	Run $cc $cflags bench_find.cpp base.cpp -o bench_find.exe
+	Run $cc $cflags bench_sort.cpp base.cpp -o bench_sort.exe
+	Run $cc $cflags bench_transcode.cpp base.cpp -o bench_transcode.exe
+	./bench_find.exe
+	./bench_sort.exe
+	./bench_transcode.exe
+	exit 0
+fi
+
 Run $cc $cflags main.cpp base.cpp -o demo.exe
 
 ./demo.exe
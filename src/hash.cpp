@@ -0,0 +1,176 @@
+#include "base.hpp"
+
+constexpr u64 xxh_prime1 = 0x9e3779b185ebca87ull;
+constexpr u64 xxh_prime2 = 0xc2b2ae3d27d4eb4full;
+constexpr u64 xxh_prime3 = 0x165667b19e3779f9ull;
+constexpr u64 xxh_prime4 = 0x85ebca77c2b2ae63ull;
+constexpr u64 xxh_prime5 = 0x27d4eb2f165667c5ull;
+
+constexpr isize xxh_stripe_size = 32;
+
+static inline
+u64 rotl64(u64 x, i32 r){
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline
+u64 read_u64(byte const* p){
+	u64 v;
+	__builtin_memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline
+u32 read_u32(byte const* p){
+	u32 v;
+	__builtin_memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline
+u64 xxh_round(u64 acc, u64 input){
+	acc += input * xxh_prime2;
+	acc  = rotl64(acc, 31);
+	acc *= xxh_prime1;
+	return acc;
+}
+
+static inline
+u64 xxh_merge_round(u64 acc, u64 val){
+	acc ^= xxh_round(0, val);
+	return acc * xxh_prime1 + xxh_prime4;
+}
+
+static inline
+void xxh_init_lanes(u64 lanes[4], u64 seed){
+	lanes[0] = seed + xxh_prime1 + xxh_prime2;
+	lanes[1] = seed + xxh_prime2;
+	lanes[2] = seed;
+	lanes[3] = seed - xxh_prime1;
+}
+
+// Consume as many whole stripes as possible, returns bytes consumed. The four
+// lanes are independent so they run in parallel (and in one vector on targets
+// with 64-bit vector multiplies).
+static
+isize xxh_consume_stripes(u64 lanes[4], byte const* p, isize nbytes){
+	isize consumed = nbytes - (nbytes % xxh_stripe_size);
+
+#if defined(__AVX512VL__) && defined(__AVX512DQ__)
+	simd::u64x4 acc = {lanes[0], lanes[1], lanes[2], lanes[3]};
+	for(isize i = 0; i < consumed; i += xxh_stripe_size){
+		simd::u64x4 input;
+		__builtin_memcpy(&input, p + i, sizeof(input));
+		acc += input * xxh_prime2;
+		acc  = (acc << 31) | (acc >> 33);
+		acc *= xxh_prime1;
+	}
+	lanes[0] = acc[0]; lanes[1] = acc[1]; lanes[2] = acc[2]; lanes[3] = acc[3];
+#else
+	u64 v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+	for(isize i = 0; i < consumed; i += xxh_stripe_size){
+		v1 = xxh_round(v1, read_u64(p + i + 0));
+		v2 = xxh_round(v2, read_u64(p + i + 8));
+		v3 = xxh_round(v3, read_u64(p + i + 16));
+		v4 = xxh_round(v4, read_u64(p + i + 24));
+	}
+	lanes[0] = v1; lanes[1] = v2; lanes[2] = v3; lanes[3] = v4;
+#endif
+
+	return consumed;
+}
+
+static
+u64 xxh_finalize(u64 h, byte const* p, isize nbytes){
+	isize i = 0;
+	for(; i + 8 <= nbytes; i += 8){
+		h ^= xxh_round(0, read_u64(p + i));
+		h  = rotl64(h, 27) * xxh_prime1 + xxh_prime4;
+	}
+	if(i + 4 <= nbytes){
+		h ^= u64(read_u32(p + i)) * xxh_prime1;
+		h  = rotl64(h, 23) * xxh_prime2 + xxh_prime3;
+		i += 4;
+	}
+	for(; i < nbytes; i += 1){
+		h ^= u64(p[i]) * xxh_prime5;
+		h  = rotl64(h, 11) * xxh_prime1;
+	}
+
+	h ^= h >> 33;
+	h *= xxh_prime2;
+	h ^= h >> 29;
+	h *= xxh_prime3;
+	h ^= h >> 32;
+	return h;
+}
+
+static
+u64 xxh_converge(u64 const lanes[4]){
+	u64 h = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+	h = xxh_merge_round(h, lanes[0]);
+	h = xxh_merge_round(h, lanes[1]);
+	h = xxh_merge_round(h, lanes[2]);
+	h = xxh_merge_round(h, lanes[3]);
+	return h;
+}
+
+u64 hash_bytes(void const* data, isize nbytes, u64 seed){
+	auto p = (byte const*)data;
+	u64 h;
+	isize consumed = 0;
+
+	if(nbytes >= xxh_stripe_size){
+		u64 lanes[4];
+		xxh_init_lanes(lanes, seed);
+		consumed = xxh_consume_stripes(lanes, p, nbytes);
+		h = xxh_converge(lanes);
+	}
+	else {
+		h = seed + xxh_prime5;
+	}
+
+	h += u64(nbytes);
+	return xxh_finalize(h, p + consumed, nbytes - consumed);
+}
+
+Hasher Hasher::make(u64 seed){
+	Hasher h = {};
+	h.seed = seed;
+	xxh_init_lanes(h.lanes, seed);
+	return h;
+}
+
+void Hasher::update(void const* data, isize nbytes){
+	auto p = (byte const*)data;
+	total_len += nbytes;
+
+	if(buffered > 0){
+		isize fill = min(xxh_stripe_size - buffered, nbytes);
+		mem_copy_no_overlap(&buffer[buffered], p, fill);
+		buffered += fill;
+		p += fill;
+		nbytes -= fill;
+		if(buffered < xxh_stripe_size){
+			return;
+		}
+		xxh_consume_stripes(lanes, buffer, xxh_stripe_size);
+		buffered = 0;
+	}
+
+	isize consumed = xxh_consume_stripes(lanes, p, nbytes);
+	buffered = nbytes - consumed;
+	mem_copy_no_overlap(buffer, p + consumed, buffered);
+}
+
+u64 Hasher::finish() const {
+	u64 h;
+	if(total_len >= xxh_stripe_size){
+		h = xxh_converge(lanes);
+	}
+	else {
+		h = seed + xxh_prime5;
+	}
+	h += u64(total_len);
+	return xxh_finalize(h, buffer, buffered);
+}
@@ -1,6 +1,100 @@
 #include "base.hpp"
+
+#if defined(PLATFORM_OS_LINUX)
+#include <stdlib.h>
+#include <malloc.h>
+
+// Every block comes from malloc or posix_memalign and is released with free,
+// so correctness never depends on the size a caller passes back. glibc
+// already maps large chunks directly and grows them with mremap inside realloc.
+
+static
+void* heap_raw_alloc(isize size, isize align, bool zero){
+	void* p = nullptr;
+	if(align <= isize(alignof(max_align_t))){
+		p = zero ? calloc(1, size) : malloc(size);
+	}
+	else if(posix_memalign(&p, align, size) == 0){
+		if(zero){
+			mem_set(p, 0, size);
+		}
+	}
+	return p;
+}
+
+static
+void heap_raw_free(void* p, isize, isize){
+	free(p);
+}
+
+static
+bool heap_raw_resize(void* p, isize, isize new_size){
+	if(p == nullptr){ return false; }
+	return new_size <= isize(malloc_usable_size(p));
+}
+
+static
+void* heap_raw_realloc(void* p, isize old_size, isize new_size, isize align){
+	if(p == nullptr){
+		return heap_raw_alloc(new_size, align, false);
+	}
+
+	if(heap_raw_resize(p, old_size, new_size)){
+		return p;
+	}
+
+	if(align <= isize(alignof(max_align_t))){
+		return ::realloc(p, new_size);
+	}
+
+	// realloc does not keep over-alignment, allocate and copy instead
+	void* new_p = heap_raw_alloc(new_size, align, false);
+	if(new_p != nullptr){
+		mem_copy_no_overlap(new_p, p, min(old_size, new_size));
+		heap_raw_free(p, old_size, align);
+	}
+	return new_p;
+}
+
+constexpr u32 heap_capabilities = u32(AllocatorCapability::AllocAny) | u32(AllocatorCapability::FreeAny) |
+                                  u32(AllocatorCapability::AlignAny) | u32(AllocatorCapability::Resize);
+
+#else
 #include <new>
 
+static
+void* heap_raw_alloc(isize size, isize align, bool zero){
+	void* p = new (std::align_val_t(align)) byte[size];
+	if(p != nullptr && zero){
+		mem_set(p, 0, size);
+	}
+	return p;
+}
+
+static
+void heap_raw_free(void* p, isize, isize align){
+	operator delete[]((byte*)p, std::align_val_t(align));
+}
+
+static
+bool heap_raw_resize(void*, isize, isize){
+	return false;
+}
+
+static
+void* heap_raw_realloc(void* p, isize old_size, isize new_size, isize align){
+	void* new_p = heap_raw_alloc(new_size, align, false);
+	if(new_p != nullptr && p != nullptr){
+		mem_copy_no_overlap(new_p, p, min(old_size, new_size));
+		heap_raw_free(p, old_size, align);
+	}
+	return new_p;
+}
+
+constexpr u32 heap_capabilities = u32(AllocatorCapability::AllocAny) | u32(AllocatorCapability::FreeAny) |
+                                  u32(AllocatorCapability::AlignAny);
+#endif
+
 static
 Result<void*, MemoryError> mem_heap_allocator_func(
 	void*,
@@ -12,34 +106,35 @@ Result<void*, MemoryError> mem_heap_allocator_func(
 	u32* capabilities
 ){
 	using M = AllocatorMode;
-	using C = AllocatorCapability;
 
 	Result<void*, MemoryError> res = {nullptr, MemoryError::None};
 
 	switch (op) {
 		case M::Query: {
-			*capabilities = u32(C::AllocAny) | u32(C::FreeAny) | u32(C::AlignAny);
+			*capabilities = heap_capabilities;
 			return res;
 		}
 
-		case M::Alloc: {
-			res.value = new (std::align_val_t(align)) byte[size];
-			[[likely]] if(res.value != nullptr){
-				mem_set(res.value, 0, size);
-			} else {
+		case M::Alloc:
+		case M::AllocNonZeroed: {
+			res.value = heap_raw_alloc(size, align, op == M::Alloc);
+			[[unlikely]] if(res.value == nullptr){
 				res.error = MemoryError::OutOfMemory;
 			}
 			return res;
 		}
 
 		case M::Resize: {
-			res.error = MemoryError::ResizeFailed;
+			if(heap_raw_resize(old_ptr, old_size, size)){
+				res.value = old_ptr;
+			} else {
+				res.error = MemoryError::ResizeFailed;
+			}
 			return res;
 		}
 
 		case M::Free: {
-			byte* old_p = (byte*)old_ptr;
-			operator delete[](old_p, std::align_val_t(align));
+			heap_raw_free(old_ptr, old_size, align);
 			return res;
 		};
 
@@ -48,16 +143,10 @@ Result<void*, MemoryError> mem_heap_allocator_func(
 		}
 
 		case M::Realloc: {
-			byte* new_p = new (std::align_val_t(align)) byte[size];
-			byte* old_p = (byte*)old_ptr;
-			isize nbytes = min(old_size, size);
-			[[likely]] if(new_p != nullptr){
-				mem_copy_no_overlap(new_p, old_p, nbytes);
-				operator delete[](old_p, std::align_val_t(align));
-			} else {
+			res.value = heap_raw_realloc(old_ptr, old_size, size, align);
+			[[unlikely]] if(res.value == nullptr){
 				res.error = MemoryError::OutOfMemory;
 			}
-			res.value = new_p;
 			return res;
 		}
 	}
@@ -72,4 +161,3 @@ Allocator heap_allocator(){
 		.func = mem_heap_allocator_func,
 	};
 }
-
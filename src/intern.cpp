@@ -0,0 +1,101 @@
+#include "base.hpp"
+
+// Copy a string that is not in the pool yet into it and assign it the next id,
+// `hash` must be map_hash(s).
+static
+Result<Symbol, MemoryError> intern_insert(InternPool* pool, String s, u64 hash){
+	ensure(pool->_strings.len() < isize(UINT32_MAX), "Intern pool ran out of symbol ids");
+
+	auto& table = pool->_table;
+	[[unlikely]] if((table.len() + 1) * 8 > table.cap() * 7){
+		if(!table.reserve(table.len() + 1)){
+			return { .value = {}, .error = MemoryError::OutOfMemory };
+		}
+	}
+
+	byte* data = nullptr;
+	if(s.len() > 0){
+		data = (byte*)pool->_arena.alloc_non_zeroed(s.len(), 1);
+		if(data == nullptr){
+			return { .value = {}, .error = MemoryError::OutOfMemory };
+		}
+		mem_copy_no_overlap(data, s.raw_data(), s.len());
+	}
+
+	String stored = String(data, s.len());
+	auto id = u32(pool->_strings.len());
+	if(!pool->_strings.append(stored)){
+		return { .value = {}, .error = MemoryError::OutOfMemory };
+	}
+	table._insert_new(stored, id, hash);
+
+	return { .value = Symbol{id}, .error = MemoryError::None };
+}
+
+Result<Symbol, MemoryError> InternPool::intern(String s){
+	u64 hash = map_hash(s);
+	isize idx = _table.find(s, hash);
+	if(idx >= 0){
+		return { .value = Symbol{_table._slots[idx].value}, .error = MemoryError::None };
+	}
+	return intern_insert(this, s, hash);
+}
+
+MemoryError InternPool::intern_all(Slice<String> strs, Slice<Symbol> out){
+	bounds_check_assert(out.len() >= strs.len(), "Output slice is too small");
+
+	if(!_table.reserve(_table.len() + strs.len())){
+		return MemoryError::OutOfMemory;
+	}
+
+	for(isize i = 0; i < strs.len(); i += 1){
+		auto [sym, error] = intern(strs[i]);
+		if(!ok(error)){
+			return error;
+		}
+		out[i] = sym;
+	}
+	return MemoryError::None;
+}
+
+Pair<Symbol, bool> InternPool::lookup(String s) const {
+	auto [id, found] = _table.get(s);
+	return { Symbol{id}, found };
+}
+
+String InternPool::get(Symbol sym) const {
+	return _strings[sym.id];
+}
+
+void InternPool::destroy(){
+	_table.destroy();
+	_strings.destroy();
+	_arena.destroy();
+}
+
+Pair<InternPool, MemoryError> InternPool::make(Allocator alloc, isize block_size){
+	InternPool pool = {};
+
+	pool._arena = Arena::make_chained(block_size);
+	if(pool._arena.data.pointer == nullptr){
+		return {pool, MemoryError::OutOfMemory};
+	}
+
+	auto [strings, strings_error] = DynamicArray<String>::make(alloc);
+	pool._strings = strings;
+	auto [table, table_error] = Map<String, u32>::make(alloc);
+	pool._table = table;
+	if(!ok(strings_error) || !ok(table_error)){
+		pool.destroy();
+		return {pool, MemoryError::OutOfMemory};
+	}
+
+	// Reserve id 0 for the empty string so zeroed symbols are valid
+	auto [_, error] = intern_insert(&pool, String(), map_hash(String()));
+	if(!ok(error)){
+		pool.destroy();
+		return {pool, error};
+	}
+
+	return {pool, MemoryError::None};
+}
@@ -17,8 +17,16 @@ Result<void*, MemoryError> Allocator::alloc(isize nbytes, isize align){
 	return this->func(this->data, AllocatorMode::Alloc, nullptr, 0, nbytes, align, nullptr);
 }
 
-Result<void*, MemoryError> Allocator::resize(void* ptr, isize new_size){
-	return this->func(this->data, AllocatorMode::Resize, ptr, 0, new_size, 0, nullptr);
+Result<void*, MemoryError> Allocator::alloc_non_zeroed(isize nbytes, isize align){
+	auto res = this->func(this->data, AllocatorMode::AllocNonZeroed, nullptr, 0, nbytes, align, nullptr);
+	[[unlikely]] if(res.error == MemoryError::UnknownMode){
+		res = this->alloc(nbytes, align);
+	}
+	return res;
+}
+
+Result<void*, MemoryError> Allocator::resize(void* ptr, isize old_size, isize new_size){
+	return this->func(this->data, AllocatorMode::Resize, ptr, old_size, new_size, 0, nullptr);
 }
 
 Result<void*, MemoryError> Allocator::realloc(void* ptr, isize old_size, isize new_size, isize align){
@@ -0,0 +1,149 @@
+#include "base.hpp"
+
+static
+Result<void*, MemoryError> pool_allocator_func(
+	void* impl,
+	AllocatorMode op,
+	void* old_ptr,
+	isize,
+	isize size,
+	isize align,
+	u32* capabilities
+){
+	auto pool = (Pool*)impl;
+	using M = AllocatorMode;
+	using C = AllocatorCapability;
+
+	Result<void*, MemoryError> res;
+
+	switch (op) {
+	case M::Query: {
+		*capabilities = u32(C::FreeAny) | u32(C::FreeAll);
+		return res;
+	}
+
+	case M::Alloc:
+	case M::AllocNonZeroed: {
+		[[unlikely]] if(size > pool->slot_size){
+			res.error = MemoryError::BadSize;
+			return res;
+		}
+		[[unlikely]] if(align > pool->slot_align){
+			res.error = MemoryError::BadAlignment;
+			return res;
+		}
+
+		res.value = (op == M::Alloc) ? pool->alloc() : pool->alloc_non_zeroed();
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+
+	case M::Resize: {
+		if(size <= pool->slot_size){
+			res.value = old_ptr;
+		} else {
+			res.error = MemoryError::ResizeFailed;
+		}
+		return res;
+	}
+
+	case M::Free: {
+		pool->free(old_ptr);
+		return res;
+	}
+
+	case M::FreeAll: {
+		pool->free_all();
+		return res;
+	}
+
+	case M::Realloc: {
+		[[unlikely]] if(size > pool->slot_size){
+			res.error = MemoryError::BadSize;
+			return res;
+		}
+		res.value = (old_ptr != nullptr) ? old_ptr : pool->alloc();
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+	}
+
+	res.error = MemoryError::UnknownMode;
+	return res;
+}
+
+Allocator Pool::as_allocator(){
+	Allocator alloc = {
+		.data = this,
+		.func = pool_allocator_func,
+	};
+	return alloc;
+}
+
+Pool Pool::make(isize slot_size, isize slot_align, isize reserve){
+	ensure(mem_valid_alignment(slot_align), "Alignment must be a power of 2");
+	ensure(slot_align <= virtual_page_size(), "Slot alignment must not be larger than a page");
+
+	slot_align = max<isize>(slot_align, alignof(PoolFreeNode));
+	slot_size  = mem_align_forward_size(max<isize>(slot_size, sizeof(PoolFreeNode)), slot_align);
+
+	Pool p = {
+		.data = PageBlock::make(reserve),
+		.offset = 0,
+		.slot_size = slot_size,
+		.slot_align = slot_align,
+		.free_list = nullptr,
+	};
+	return p;
+}
+
+void* Pool::alloc_non_zeroed(){
+	[[likely]] if(free_list != nullptr){
+		PoolFreeNode* node = free_list;
+		free_list = node->next;
+		return node;
+	}
+
+	if(offset + slot_size > data.commited){
+		if(data.push(offset + slot_size - data.commited) == nullptr){
+			return nullptr; /* Out of memory */
+		}
+	}
+
+	void* slot = (u8*)data.pointer + offset;
+	offset += slot_size;
+	return slot;
+}
+
+void* Pool::alloc(){
+	void* slot = this->alloc_non_zeroed();
+	if(slot != nullptr){
+		mem_set(slot, 0, slot_size);
+	}
+	return slot;
+}
+
+void Pool::free(void* ptr){
+	if(ptr == nullptr){ return; }
+
+	[[maybe_unused]] isize slot_offset = (u8*)ptr - (u8*)data.pointer;
+	debug_assert(slot_offset >= 0 && slot_offset < offset && (slot_offset % slot_size) == 0, "Pointer is not a slot owned by the pool");
+
+	auto node = (PoolFreeNode*)ptr;
+	node->next = free_list;
+	free_list = node;
+}
+
+void Pool::free_all(){
+	free_list = nullptr;
+	offset = 0;
+}
+
+void Pool::destroy(){
+	this->free_all();
+	data.destroy();
+}
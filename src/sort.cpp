@@ -0,0 +1,195 @@
+#include "base.hpp"
+
+constexpr isize radix_bucket_count = 256;
+
+// Sort by unsigned keys of the same size as T, `key` maps elements to keys
+// whose unsigned order is the wanted order.
+template<typename T, typename KeyFn>
+static
+MemoryError radix_sort_lsd(Slice<T> s, Allocator scratch, KeyFn key){
+	constexpr isize digit_count = sizeof(T);
+	isize n = s.len();
+
+	if(n < radix_sort_threshold){
+		sort(s, [&](T a, T b){ return key(a) < key(b); });
+		return MemoryError::None;
+	}
+
+	auto [buf, error] = scratch.alloc_non_zeroed(n * sizeof(T), alignof(T));
+	if(!ok(error)){
+		return error;
+	}
+
+	// Histograms of every digit, in a single pass over the input
+	isize counts[digit_count][radix_bucket_count] = {};
+	T* src = s.raw_data();
+	for(isize i = 0; i < n; i += 1){
+		auto k = key(src[i]);
+		for(isize d = 0; d < digit_count; d += 1){
+			counts[d][(k >> (d * 8)) & 0xff] += 1;
+		}
+	}
+
+	T* dst = (T*)buf;
+	for(isize d = 0; d < digit_count; d += 1){
+		isize* count = counts[d];
+		isize shift = d * 8;
+
+		// Every key has the same digit, the pass would not move anything
+		if(count[(key(src[0]) >> shift) & 0xff] == n){
+			continue;
+		}
+
+		isize offsets[radix_bucket_count];
+		isize total = 0;
+		for(isize b = 0; b < radix_bucket_count; b += 1){
+			offsets[b] = total;
+			total += count[b];
+		}
+
+		for(isize i = 0; i < n; i += 1){
+			auto digit = (key(src[i]) >> shift) & 0xff;
+			dst[offsets[digit]] = src[i];
+			offsets[digit] += 1;
+		}
+		swap(&src, &dst);
+	}
+
+	if(src != s.raw_data()){
+		mem_copy_no_overlap(s.raw_data(), src, n * sizeof(T));
+	}
+	scratch.free(buf, n * sizeof(T), alignof(T));
+	return MemoryError::None;
+}
+
+MemoryError radix_sort(Slice<u32> s, Allocator scratch){
+	return radix_sort_lsd(s, scratch, [](u32 v){ return v; });
+}
+
+MemoryError radix_sort(Slice<u64> s, Allocator scratch){
+	return radix_sort_lsd(s, scratch, [](u64 v){ return v; });
+}
+
+// Flipping the sign bit maps two's complement order onto unsigned order
+MemoryError radix_sort(Slice<i32> s, Allocator scratch){
+	return radix_sort_lsd(s, scratch, [](i32 v){ return u32(v) ^ (u32(1) << 31); });
+}
+
+MemoryError radix_sort(Slice<i64> s, Allocator scratch){
+	return radix_sort_lsd(s, scratch, [](i64 v){ return u64(v) ^ (u64(1) << 63); });
+}
+
+// Negative floats have all bits flipped (larger magnitude sorts first), positive
+// ones only the sign bit
+MemoryError radix_sort(Slice<f32> s, Allocator scratch){
+	return radix_sort_lsd(s, scratch, [](f32 v){
+		u32 bits;
+		__builtin_memcpy(&bits, &v, sizeof(bits));
+		u32 mask = u32(i32(bits) >> 31) | (u32(1) << 31);
+		return bits ^ mask;
+	});
+}
+
+MemoryError radix_sort(Slice<f64> s, Allocator scratch){
+	return radix_sort_lsd(s, scratch, [](f64 v){
+		u64 bits;
+		__builtin_memcpy(&bits, &v, sizeof(bits));
+		u64 mask = u64(i64(bits) >> 63) | (u64(1) << 63);
+		return bits ^ mask;
+	});
+}
+
+// Bucket of a string at byte `depth`, 0 for strings that already ended
+static inline
+isize string_digit(String s, isize depth){
+	return (depth < s.len()) ? isize(s.raw_data()[depth]) + 1 : 0;
+}
+
+static
+void radix_sort_strings(String* data, String* tmp, isize n, isize depth){
+	constexpr isize bucket_count = radix_bucket_count + 1;
+
+	while(true){
+		if(n < radix_sort_threshold){
+			// Everything before `depth` is a shared prefix
+			sort(Slice<String>(data, n), [depth](String a, String b){
+				isize la = a.len() - depth;
+				isize lb = b.len() - depth;
+				isize m = min(la, lb);
+				if(m > 0){
+					i32 cmp = mem_compare(a.raw_data() + depth, b.raw_data() + depth, m);
+					if(cmp != 0){ return cmp < 0; }
+				}
+				return la < lb;
+			});
+			return;
+		}
+
+		isize counts[bucket_count] = {};
+		for(isize i = 0; i < n; i += 1){
+			counts[string_digit(data[i], depth)] += 1;
+		}
+
+		// Shared byte, move on to the next one without touching the data
+		isize first_digit = string_digit(data[0], depth);
+		if(counts[first_digit] == n){
+			if(first_digit == 0){ return; }
+			depth += 1;
+			continue;
+		}
+
+		isize offsets[bucket_count];
+		isize total = 0;
+		for(isize b = 0; b < bucket_count; b += 1){
+			offsets[b] = total;
+			total += counts[b];
+		}
+		for(isize i = 0; i < n; i += 1){
+			isize digit = string_digit(data[i], depth);
+			tmp[offsets[digit]] = data[i];
+			offsets[digit] += 1;
+		}
+		mem_copy_no_overlap(data, tmp, n * sizeof(String));
+
+		// Strings that ended are all equal, the other buckets need the next byte.
+		// The largest bucket is handled by the loop and only smaller ones
+		// recurse, which keeps the depth within log2(n).
+		isize largest = 1;
+		for(isize b = 2; b < bucket_count; b += 1){
+			if(counts[b] > counts[largest]){ largest = b; }
+		}
+
+		isize start = counts[0];
+		isize largest_start = 0;
+		for(isize b = 1; b < bucket_count; b += 1){
+			if(b == largest){
+				largest_start = start;
+			}
+			else if(counts[b] > 1){
+				radix_sort_strings(data + start, tmp + start, counts[b], depth + 1);
+			}
+			start += counts[b];
+		}
+
+		data += largest_start;
+		tmp += largest_start;
+		n = counts[largest];
+		depth += 1;
+	}
+}
+
+MemoryError radix_sort(Slice<String> s, Allocator scratch){
+	isize n = s.len();
+	if(n < radix_sort_threshold){
+		sort(s);
+		return MemoryError::None;
+	}
+
+	auto [buf, error] = scratch.alloc_non_zeroed(n * sizeof(String), alignof(String));
+	if(!ok(error)){
+		return error;
+	}
+	radix_sort_strings(s.raw_data(), (String*)buf, n, 0);
+	scratch.free(buf, n * sizeof(String), alignof(String));
+	return MemoryError::None;
+}
@@ -0,0 +1,179 @@
+#include "base.hpp"
+
+static
+Result<void*, MemoryError> stack_allocator_func(
+	void* impl,
+	AllocatorMode op,
+	void* old_ptr,
+	isize old_size,
+	isize size,
+	isize align,
+	u32* capabilities
+){
+	auto stack = (Stack*)impl;
+	using M = AllocatorMode;
+	using C = AllocatorCapability;
+
+	Result<void*, MemoryError> res;
+
+	switch (op) {
+	case M::Query: {
+		*capabilities = u32(C::AllocAny) | u32(C::AlignAny) | u32(C::FreeAll) | u32(C::Resize);
+		return res;
+	}
+
+	case M::Alloc: {
+		res.value = stack->alloc(size, align);
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+
+	case M::AllocNonZeroed: {
+		res.value = stack->alloc_non_zeroed(size, align);
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+
+	case M::Resize: {
+		res.value = stack->resize_in_place(old_ptr, size);
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::ResizeFailed;
+		}
+		return res;
+	}
+
+	case M::Free: {
+		res.error = stack->free(old_ptr);
+		return res;
+	}
+
+	case M::FreeAll: {
+		stack->free_all();
+		return res;
+	}
+
+	case M::Realloc: {
+		res.value = stack->realloc(old_ptr, old_size, size, align);
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+	}
+
+	res.error = MemoryError::UnknownMode;
+	return res;
+}
+
+Allocator Stack::as_allocator(){
+	Allocator alloc = {
+		.data = this,
+		.func = stack_allocator_func,
+	};
+	return alloc;
+}
+
+Stack Stack::make(isize reserve){
+	Stack s = {
+		.data = PageBlock::make(reserve),
+		.offset = 0,
+		.top = 0,
+	};
+	return s;
+}
+
+// Make sure memory up to `end` bytes from the start of the stack is committed
+static
+bool stack_ensure_committed(Stack* s, isize end){
+	if(end <= s->data.commited){
+		return true;
+	}
+	return s->data.push(end - s->data.commited) != nullptr;
+}
+
+void* Stack::alloc_non_zeroed(isize size, isize align){
+	ensure(mem_valid_alignment(align), "Alignment must be a power of 2");
+	uintptr base    = uintptr(data.pointer);
+	uintptr current = base + uintptr(offset);
+	uintptr payload = mem_align_forward_ptr(current + sizeof(StackHeader), max<isize>(align, alignof(StackHeader)));
+	isize end = isize(payload - base) + size;
+
+	if(!stack_ensure_committed(this, end)){
+		return nullptr; /* Out of memory */
+	}
+
+	auto header = (StackHeader*)(payload - sizeof(StackHeader));
+	header->prev_offset = offset;
+	header->prev_top = top;
+
+	top = isize(payload - base);
+	offset = end;
+	return (void*)payload;
+}
+
+void* Stack::alloc(isize size, isize align){
+	void* p = this->alloc_non_zeroed(size, align);
+	if(p != nullptr){
+		mem_set(p, 0, size);
+	}
+	return p;
+}
+
+void* Stack::resize_in_place(void* ptr, isize new_size){
+	uintptr base = uintptr(data.pointer);
+	if(ptr == nullptr || top == 0 || uintptr(ptr) != base + uintptr(top)){
+		return nullptr;
+	}
+
+	isize end = top + new_size;
+	if(!stack_ensure_committed(this, end)){
+		return nullptr;
+	}
+	offset = end;
+	return ptr;
+}
+
+void* Stack::realloc(void* ptr, isize old_size, isize new_size, isize align){
+	if(ptr == nullptr){
+		return this->alloc_non_zeroed(new_size, align);
+	}
+
+	void* new_ptr = this->resize_in_place(ptr, new_size);
+	if(new_ptr == nullptr){
+		new_ptr = this->alloc_non_zeroed(new_size, align);
+		if(new_ptr != nullptr){
+			mem_copy_no_overlap(new_ptr, ptr, min(old_size, new_size));
+		}
+	}
+	return new_ptr;
+}
+
+MemoryError Stack::free(void* ptr){
+	if(ptr == nullptr){
+		return MemoryError::None;
+	}
+
+	uintptr base = uintptr(data.pointer);
+	[[unlikely]] if(top == 0 || uintptr(ptr) != base + uintptr(top)){
+		return MemoryError::BadFree; /* Out of order free */
+	}
+
+	auto header = (StackHeader*)(uintptr(ptr) - sizeof(StackHeader));
+	offset = header->prev_offset;
+	top = header->prev_top;
+	return MemoryError::None;
+}
+
+void Stack::free_all(){
+	offset = 0;
+	top = 0;
+}
+
+void Stack::destroy(){
+	this->free_all();
+	data.destroy();
+}
@@ -39,12 +39,7 @@ String str_concat(String s0, String s1, Allocator a){
 }
 
 isize str_rune_count(String s) {
-	[[maybe_unused]] rune r;
-	[[maybe_unused]] i32 n;
-	auto it = str_iterator(s);
-	isize size = 0;
-	while(iter_next(&it, &r, &n)) { size += 1; }
-	return size;
+	return utf8_rune_count(Slice<byte>(s.raw_data(), s.len()));
 }
 
 bool str_starts_with(String s, String prefix){
@@ -54,6 +49,15 @@ bool str_starts_with(String s, String prefix){
 	return cmp == 0;
 }
 
+i32 str_compare(String a, String b){
+	isize n = min(a.len(), b.len());
+	if(n > 0){
+		i32 cmp = mem_compare(a.raw_data(), b.raw_data(), n);
+		if(cmp != 0){ return cmp; }
+	}
+	return i32(a.len() > b.len()) - i32(a.len() < b.len());
+}
+
 bool str_ends_with(String s, String suffix){
 	if(suffix.len() == 0){ return true; }
 	if(suffix.len() > s.len()){ return false; }
@@ -156,21 +160,181 @@ String str_trim_trailing(String s, String cutset) {
 	return s.slice_left(cut_until);
 }
 
-isize find(String s, String pattern, isize start){
-	bounds_check_assert(start < s.len(), "Cannot begin searching after string length");
-	if(pattern.len() > s.len()){ return -1; }
-	else if(pattern.len() == 0){ return start; }
+// Needles up to this length use the first/last byte prefilter, longer ones
+// use Horspool, whose shifts grow with the needle
+constexpr isize short_needle_len = 32;
 
-	auto source_p  = s.raw_data();
-	auto pattern_p = pattern.raw_data();
+static inline
+u32 block_matches(byte const* p, simd::u8x16 b){
+	return simd::movemask((simd::u8x16)(simd::load_u8x16(p) == b));
+}
+
+static
+isize find_byte(byte const* s, isize n, byte c, isize start){
+	simd::u8x16 vc = simd::splat_u8x16(c);
+	isize i = start;
+	for(; i + 16 <= n; i += 16){
+		u32 mask = block_matches(&s[i], vc);
+		if(mask != 0){ return i + __builtin_ctz(mask); }
+	}
+	for(; i < n; i += 1){
+		if(s[i] == c){ return i; }
+	}
+	return -1;
+}
+
+static
+isize find_byte_reverse(byte const* s, isize n, byte c){
+	simd::u8x16 vc = simd::splat_u8x16(c);
+	isize i = n;
+	for(; i >= 16; i -= 16){
+		u32 mask = block_matches(&s[i - 16], vc);
+		if(mask != 0){ return i - 16 + (31 - __builtin_clz(mask)); }
+	}
+	for(i -= 1; i >= 0; i -= 1){
+		if(s[i] == c){ return i; }
+	}
+	return -1;
+}
 
-	auto length = s.len() - pattern.len();
+// Compare the first and last byte of the needle against 16 candidate
+// positions at once, only candidates passing both get a full comparison.
+static
+isize find_prefilter(byte const* s, isize n, byte const* p, isize m, isize start){
+	simd::u8x16 first = simd::splat_u8x16(p[0]);
+	simd::u8x16 last  = simd::splat_u8x16(p[m - 1]);
+	isize i = start;
+
+	for(; i + 16 + m - 1 <= n; i += 16){
+		u32 mask = block_matches(&s[i], first) & block_matches(&s[i + m - 1], last);
+		while(mask != 0){
+			isize pos = i + __builtin_ctz(mask);
+			if(mem_compare(&s[pos + 1], &p[1], m - 2) == 0){ return pos; }
+			mask &= mask - 1;
+		}
+	}
+	for(; i <= n - m; i += 1){
+		if(s[i] == p[0] && s[i + m - 1] == p[m - 1] && mem_compare(&s[i + 1], &p[1], m - 2) == 0){
+			return i;
+		}
+	}
+	return -1;
+}
 
-	for(isize i = start; i < length; i++){
-		if(mem_compare(&source_p[i], pattern_p, pattern.len()) == 0){
+static
+isize find_prefilter_reverse(byte const* s, isize n, byte const* p, isize m){
+	simd::u8x16 first = simd::splat_u8x16(p[0]);
+	simd::u8x16 last  = simd::splat_u8x16(p[m - 1]);
+	isize i = n - m + 1; // One past the last candidate
+
+	for(; i >= 16; i -= 16){
+		isize base = i - 16;
+		u32 mask = block_matches(&s[base], first) & block_matches(&s[base + m - 1], last);
+		while(mask != 0){
+			i32 bit = 31 - __builtin_clz(mask);
+			if(mem_compare(&s[base + bit + 1], &p[1], m - 2) == 0){ return base + bit; }
+			mask &= ~(u32(1) << bit);
+		}
+	}
+	for(i -= 1; i >= 0; i -= 1){
+		if(s[i] == p[0] && s[i + m - 1] == p[m - 1] && mem_compare(&s[i + 1], &p[1], m - 2) == 0){
 			return i;
 		}
 	}
+	return -1;
+}
 
+static inline
+u32 bigram_hash(byte a, byte b){
+	return ((u32(a) << 3) ^ u32(b)) & 0xff;
+}
+
+// Boyer-Moore-Horspool keyed on the last two bytes of the window, which gives
+// much longer shifts than a single byte on small alphabets. Colliding
+// bigrams keep the smaller shift, so the table stays conservative.
+static
+isize find_horspool(byte const* s, isize n, byte const* p, isize m, isize start){
+	isize shift[256];
+	for(isize h = 0; h < 256; h += 1){ shift[h] = m - 1; }
+	for(isize j = 1; j < m - 1; j += 1){ shift[bigram_hash(p[j - 1], p[j])] = m - 1 - j; }
+
+	u32 tail = bigram_hash(p[m - 2], p[m - 1]);
+	isize skip = shift[tail];
+	shift[tail] = 0;
+
+	for(isize i = start; i <= n - m; ){
+		isize d = shift[bigram_hash(s[i + m - 2], s[i + m - 1])];
+		if(d == 0){
+			if(mem_compare(&s[i], p, m) == 0){ return i; }
+			d = skip;
+		}
+		i += d;
+	}
+	return -1;
+}
+
+// Mirror image of find_horspool, keyed on the first two bytes of the window
+static
+isize find_horspool_reverse(byte const* s, isize n, byte const* p, isize m){
+	isize shift[256];
+	for(isize h = 0; h < 256; h += 1){ shift[h] = m - 1; }
+	for(isize j = m - 2; j > 0; j -= 1){ shift[bigram_hash(p[j], p[j + 1])] = j; }
+
+	u32 head = bigram_hash(p[0], p[1]);
+	isize skip = shift[head];
+	shift[head] = 0;
+
+	for(isize i = n - m; i >= 0; ){
+		isize d = shift[bigram_hash(s[i], s[i + 1])];
+		if(d == 0){
+			if(mem_compare(&s[i], p, m) == 0){ return i; }
+			d = skip;
+		}
+		i -= d;
+	}
 	return -1;
 }
+
+static
+isize find_forward(byte const* s, isize n, byte const* p, isize m, isize start){
+	if(m > n - start){ return -1; }
+	if(m == 1){ return find_byte(s, n, p[0], start); }
+	if(m <= short_needle_len){ return find_prefilter(s, n, p, m, start); }
+	return find_horspool(s, n, p, m, start);
+}
+
+isize str_find(String s, String substr, isize start){
+	bounds_check_assert(start >= 0 && start <= s.len(), "Cannot begin searching after string length");
+	if(substr.len() == 0){ return start; }
+	return find_forward(s.raw_data(), s.len(), substr.raw_data(), substr.len(), start);
+}
+
+isize str_find_last(String s, String substr){
+	byte const* src = s.raw_data();
+	byte const* p   = substr.raw_data();
+	isize n = s.len();
+	isize m = substr.len();
+
+	if(m == 0){ return n; }
+	if(m > n){ return -1; }
+	if(m == 1){ return find_byte_reverse(src, n, p[0]); }
+	if(m <= short_needle_len){ return find_prefilter_reverse(src, n, p, m); }
+	return find_horspool_reverse(src, n, p, m);
+}
+
+isize str_find_all(String s, String substr, Slice<isize> positions){
+	byte const* src = s.raw_data();
+	byte const* p   = substr.raw_data();
+	isize n = s.len();
+	isize m = substr.len();
+	if(m == 0){ return 0; }
+
+	isize count = 0;
+	for(isize pos = find_forward(src, n, p, m, 0); pos >= 0; pos = find_forward(src, n, p, m, pos + m)){
+		if(count < positions.len()){
+			positions[count] = pos;
+		}
+		count += 1;
+	}
+	return count;
+}
@@ -0,0 +1,542 @@
+#include "base.hpp"
+
+struct ThreadHeap;
+
+struct ThreadFreeNode {
+	ThreadFreeNode* next;
+};
+
+// Header at the start of every span, slots are packed at the end of the span so
+// power of 2 size classes are naturally aligned to their size.
+struct ThreadSpan {
+	alignas(cache_line_size) Atomic<ThreadFreeNode*> remote_free;
+
+	alignas(cache_line_size) Atomic<ThreadHeap*> owner;
+	ThreadSpan* next;
+	ThreadSpan* prev;
+	ThreadFreeNode* free_list;
+	isize class_index; // thread_heap_large_class for large allocations
+	isize slot_size;
+	isize slot_offset; // Offset of the first slot
+	isize capacity;
+	isize bump;        // Slots that were handed out at least once
+	isize used;        // Live slots, counting remote frees that were not collected yet
+	bool  in_full;
+	bool  committed;   // Payload pages are committed, the header page always is
+
+	// Large allocations only
+	void* mapping;
+	isize mapping_size;
+};
+
+constexpr isize thread_heap_large_class = -1;
+
+struct ThreadHeap {
+	ThreadSpan* available[thread_heap_class_count];
+	ThreadSpan* full[thread_heap_class_count];
+	isize ticks;
+
+	~ThreadHeap();
+};
+
+struct ThreadHeapGlobal {
+	Atomic<bool> lock;
+	ThreadSpan* free_spans;
+	isize free_span_count;
+	ThreadSpan* abandoned[thread_heap_class_count];
+
+	// Current address space reservation new spans are carved from
+	u8* region_cursor;
+	u8* region_end;
+};
+
+constexpr isize thread_heap_region_size = 64 * thread_heap_span_size;
+
+static ThreadHeapGlobal thread_heap_global;
+
+static thread_local ThreadHeap thread_heap;
+
+static
+void global_lock(){
+	auto& lock = thread_heap_global.lock;
+	while(lock.exchange(true, std::memory_order_acquire)){
+		while(lock.load(std::memory_order_relaxed)){
+			spin_pause();
+		}
+	}
+}
+
+static
+void global_unlock(){
+	thread_heap_global.lock.store(false, std::memory_order_release);
+}
+
+// 16 byte steps up to 128, then 4 classes per power of 2
+static inline
+isize class_size(isize idx){
+	if(idx < 8){
+		return 16 * (idx + 1);
+	}
+	isize group = (idx - 8) / 4;
+	isize step  = (idx - 8) % 4;
+	isize base  = isize(128) << group;
+	return base + (step + 1) * (base / 4);
+}
+
+static inline
+isize class_index(isize size){
+	if(size <= 128){
+		return (max<isize>(size, 1) + 15) / 16 - 1;
+	}
+	i32 f = 63 - __builtin_clzll(u64(size - 1));
+	return 8 + (f - 7) * 4 + ((size - 1) >> (f - 2)) - 4;
+}
+
+static inline
+ThreadSpan* span_of(void* ptr){
+	return (ThreadSpan*)(uintptr(ptr) & ~uintptr(thread_heap_span_size - 1));
+}
+
+static
+void list_push(ThreadSpan** list, ThreadSpan* span){
+	span->prev = nullptr;
+	span->next = *list;
+	if(*list != nullptr){
+		(*list)->prev = span;
+	}
+	*list = span;
+}
+
+static
+void list_remove(ThreadSpan** list, ThreadSpan* span){
+	if(span->prev != nullptr){
+		span->prev->next = span->next;
+	} else {
+		*list = span->next;
+	}
+	if(span->next != nullptr){
+		span->next->prev = span->prev;
+	}
+	span->next = nullptr;
+	span->prev = nullptr;
+}
+
+// Move every pending remote free into the span's local free list
+static
+void span_collect(ThreadSpan* span){
+	ThreadFreeNode* list = span->remote_free.exchange(nullptr, std::memory_order_acquire);
+	if(list == nullptr){ return; }
+
+	isize count = 1;
+	ThreadFreeNode* tail = list;
+	while(tail->next != nullptr){
+		tail = tail->next;
+		count += 1;
+	}
+	tail->next = span->free_list;
+	span->free_list = list;
+	span->used -= count;
+}
+
+static
+void* span_pop(ThreadSpan* span){
+	[[unlikely]] if(span->free_list == nullptr && span->bump >= span->capacity){
+		span_collect(span);
+	}
+
+	ThreadFreeNode* node = span->free_list;
+	if(node != nullptr){
+		span->free_list = node->next;
+		span->used += 1;
+		return node;
+	}
+
+	if(span->bump < span->capacity){
+		void* slot = (u8*)span + span->slot_offset + span->bump * span->slot_size;
+		span->bump += 1;
+		span->used += 1;
+		return slot;
+	}
+
+	return nullptr;
+}
+
+// Get an empty, committed span from the global pool or from fresh address space
+static
+ThreadSpan* span_acquire(){
+	ThreadSpan* span = nullptr;
+	bool fresh = false;
+
+	global_lock();
+	auto& g = thread_heap_global;
+	if(g.free_spans != nullptr){
+		span = g.free_spans;
+		g.free_spans = span->next;
+		g.free_span_count -= 1;
+	}
+	else {
+		if(g.region_cursor == g.region_end){
+			// Over-reserve so spans can be aligned to their size
+			u8* region = (u8*)virtual_reserve(thread_heap_region_size + thread_heap_span_size);
+			if(region != nullptr){
+				g.region_cursor = (u8*)mem_align_forward_ptr(uintptr(region), thread_heap_span_size);
+				g.region_end = g.region_cursor + thread_heap_region_size;
+			}
+		}
+		if(g.region_cursor != g.region_end){
+			span = (ThreadSpan*)g.region_cursor;
+			g.region_cursor += thread_heap_span_size;
+			fresh = true;
+		}
+	}
+	global_unlock();
+
+	if(span == nullptr){
+		return nullptr;
+	}
+
+	if(fresh){
+		if(virtual_commit(span, thread_heap_span_size) == nullptr){
+			return nullptr;
+		}
+		span->committed = true;
+	}
+	else if(!span->committed){
+		isize page_size = virtual_page_size();
+		if(virtual_commit((u8*)span + page_size, thread_heap_span_size - page_size) == nullptr){
+			global_lock();
+			span->next = g.free_spans;
+			g.free_spans = span;
+			g.free_span_count += 1;
+			global_unlock();
+			return nullptr;
+		}
+		span->committed = true;
+	}
+	return span;
+}
+
+// Return an empty span to the global pool, decommitting it if the pool is full
+static
+void span_release(ThreadSpan* span){
+	span->owner.store(nullptr, std::memory_order_relaxed);
+
+	global_lock();
+	auto& g = thread_heap_global;
+	if(g.free_span_count >= thread_heap_max_free_spans && span->committed){
+		isize page_size = virtual_page_size();
+		virtual_decommit((u8*)span + page_size, thread_heap_span_size - page_size);
+		span->committed = false;
+	}
+	span->next = g.free_spans;
+	g.free_spans = span;
+	g.free_span_count += 1;
+	global_unlock();
+}
+
+static
+ThreadSpan* span_make(ThreadHeap* heap, isize cls){
+	ThreadSpan* span = nullptr;
+
+	// Prefer adopting a span that was abandoned by a thread that exited
+	global_lock();
+	auto& g = thread_heap_global;
+	if(g.abandoned[cls] != nullptr){
+		span = g.abandoned[cls];
+		g.abandoned[cls] = span->next;
+	}
+	global_unlock();
+
+	if(span != nullptr){
+		span->owner.store(heap, std::memory_order_relaxed);
+		span_collect(span);
+		return span;
+	}
+
+	span = span_acquire();
+	if(span == nullptr){
+		return nullptr;
+	}
+
+	isize slot_size = class_size(cls);
+	isize capacity  = (thread_heap_span_size - isize(sizeof(ThreadSpan))) / slot_size;
+
+	span->remote_free.store(nullptr, std::memory_order_relaxed);
+	span->owner.store(heap, std::memory_order_relaxed);
+	span->next = nullptr;
+	span->prev = nullptr;
+	span->free_list = nullptr;
+	span->class_index = cls;
+	span->slot_size = slot_size;
+	span->slot_offset = thread_heap_span_size - capacity * slot_size;
+	span->capacity = capacity;
+	span->bump = 0;
+	span->used = 0;
+	span->in_full = false;
+	span->mapping = nullptr;
+	span->mapping_size = 0;
+	return span;
+}
+
+// Drain remote frees of spans considered full, give back empty spans beyond the
+// first one of each class.
+static
+void heap_rebalance(ThreadHeap* heap){
+	for(isize cls = 0; cls < thread_heap_class_count; cls += 1){
+		ThreadSpan* next = nullptr;
+		for(ThreadSpan* span = heap->full[cls]; span != nullptr; span = next){
+			next = span->next;
+			span_collect(span);
+			if(span->used < span->capacity){
+				list_remove(&heap->full[cls], span);
+				list_push(&heap->available[cls], span);
+				span->in_full = false;
+			}
+		}
+
+		bool kept_empty = false;
+		for(ThreadSpan* span = heap->available[cls]; span != nullptr; span = next){
+			next = span->next;
+			span_collect(span);
+			if(span->used == 0){
+				if(kept_empty){
+					list_remove(&heap->available[cls], span);
+					span_release(span);
+				}
+				kept_empty = true;
+			}
+		}
+	}
+}
+
+static
+void heap_tick(ThreadHeap* heap){
+	heap->ticks += 1;
+	[[unlikely]] if(heap->ticks >= thread_heap_rebalance_ticks){
+		heap->ticks = 0;
+		heap_rebalance(heap);
+	}
+}
+
+static
+void* heap_alloc_small(ThreadHeap* heap, isize cls){
+	ThreadSpan* span = heap->available[cls];
+	while(span != nullptr){
+		void* p = span_pop(span);
+		[[likely]] if(p != nullptr){
+			return p;
+		}
+		list_remove(&heap->available[cls], span);
+		list_push(&heap->full[cls], span);
+		span->in_full = true;
+		span = heap->available[cls];
+	}
+
+	// Full spans that got remote frees are picked up again by heap_rebalance
+	span = span_make(heap, cls);
+	if(span == nullptr){
+		return nullptr;
+	}
+	list_push(&heap->available[cls], span);
+	return span_pop(span);
+}
+
+static
+void heap_free_small(ThreadHeap* heap, ThreadSpan* span, void* ptr){
+	if(span->owner.load(std::memory_order_relaxed) != heap){
+		auto node = (ThreadFreeNode*)ptr;
+		node->next = span->remote_free.load(std::memory_order_relaxed);
+		while(!span->remote_free.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)){
+			spin_pause();
+		}
+		return;
+	}
+
+	auto node = (ThreadFreeNode*)ptr;
+	node->next = span->free_list;
+	span->free_list = node;
+	span->used -= 1;
+
+	isize cls = span->class_index;
+	if(span->in_full){
+		list_remove(&heap->full[cls], span);
+		list_push(&heap->available[cls], span);
+		span->in_full = false;
+	}
+	heap_tick(heap);
+}
+
+static
+void* large_alloc(isize size, isize align){
+	isize page_size = virtual_page_size();
+	isize header = mem_align_forward_size(max<isize>(sizeof(ThreadSpan), align), page_size);
+	isize nbytes = mem_align_forward_size(header + size, page_size);
+
+	// Over-reserve so the header lands on a span boundary
+	isize mapping_size = nbytes + thread_heap_span_size;
+	void* mapping = virtual_reserve(mapping_size);
+	if(mapping == nullptr){
+		return nullptr;
+	}
+
+	auto span = (ThreadSpan*)mem_align_forward_ptr(uintptr(mapping), thread_heap_span_size);
+	if(virtual_commit(span, nbytes) == nullptr){
+		virtual_release(mapping, mapping_size);
+		return nullptr;
+	}
+
+	span->owner.store(nullptr, std::memory_order_relaxed);
+	span->class_index = thread_heap_large_class;
+	span->slot_size = nbytes - header;
+	span->slot_offset = header;
+	span->mapping = mapping;
+	span->mapping_size = mapping_size;
+	return (u8*)span + header;
+}
+
+static
+void large_free(ThreadSpan* span){
+	virtual_release(span->mapping, span->mapping_size);
+}
+
+ThreadHeap::~ThreadHeap(){
+	for(isize cls = 0; cls < thread_heap_class_count; cls += 1){
+		ThreadSpan** lists[2] = { &available[cls], &full[cls] };
+		for(ThreadSpan** list : lists){
+			ThreadSpan* next = nullptr;
+			for(ThreadSpan* span = *list; span != nullptr; span = next){
+				next = span->next;
+				span_collect(span);
+				span->in_full = false;
+				if(span->used == 0){
+					span_release(span);
+					continue;
+				}
+
+				// Objects still alive, leave the span for another thread to adopt
+				span->owner.store(nullptr, std::memory_order_release);
+				global_lock();
+				span->prev = nullptr;
+				span->next = thread_heap_global.abandoned[cls];
+				thread_heap_global.abandoned[cls] = span;
+				global_unlock();
+			}
+			*list = nullptr;
+		}
+	}
+}
+
+static
+isize small_class_for(isize size, isize align){
+	if(align > 16){
+		// Only power of 2 classes are aligned past 16 bytes
+		size = max(size, align);
+		size = isize(1) << (64 - __builtin_clzll(u64(size - 1)));
+	}
+	if(size > thread_heap_max_small_size){
+		return thread_heap_large_class;
+	}
+	return class_index(size);
+}
+
+static
+Result<void*, MemoryError> thread_heap_allocator_func(
+	void*,
+	AllocatorMode op,
+	void* old_ptr,
+	isize old_size,
+	isize size,
+	isize align,
+	u32* capabilities
+){
+	using M = AllocatorMode;
+	using C = AllocatorCapability;
+
+	Result<void*, MemoryError> res;
+	ThreadHeap* heap = &thread_heap;
+
+	switch (op) {
+	case M::Query: {
+		*capabilities = u32(C::AllocAny) | u32(C::FreeAny) | u32(C::Resize);
+		return res;
+	}
+
+	case M::Alloc:
+	case M::AllocNonZeroed: {
+		[[unlikely]] if(!mem_valid_alignment(align) || align > virtual_page_size()){
+			res.error = MemoryError::BadAlignment;
+			return res;
+		}
+
+		isize cls = small_class_for(size, align);
+		if(cls == thread_heap_large_class){
+			// Large allocations come from fresh zeroed pages
+			res.value = large_alloc(size, align);
+		}
+		else {
+			res.value = heap_alloc_small(heap, cls);
+			heap_tick(heap);
+			if(res.value != nullptr && op == M::Alloc){
+				mem_set(res.value, 0, size);
+			}
+		}
+
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+
+	case M::Resize: {
+		ThreadSpan* span = span_of(old_ptr);
+		if(old_ptr != nullptr && size <= span->slot_size){
+			res.value = old_ptr;
+		} else {
+			res.error = MemoryError::ResizeFailed;
+		}
+		return res;
+	}
+
+	case M::Free: {
+		if(old_ptr == nullptr){ return res; }
+		ThreadSpan* span = span_of(old_ptr);
+		if(span->class_index == thread_heap_large_class){
+			large_free(span);
+		} else {
+			heap_free_small(heap, span, old_ptr);
+		}
+		return res;
+	}
+
+	case M::FreeAll: {
+		return res;
+	}
+
+	case M::Realloc: {
+		if(old_ptr != nullptr){
+			ThreadSpan* span = span_of(old_ptr);
+			if(size <= span->slot_size && (uintptr(old_ptr) & uintptr(align - 1)) == 0){
+				res.value = old_ptr;
+				return res;
+			}
+		}
+
+		res = thread_heap_allocator_func(nullptr, M::AllocNonZeroed, nullptr, 0, size, align, nullptr);
+		if(ok(res) && old_ptr != nullptr){
+			mem_copy_no_overlap(res.value, old_ptr, min(old_size, size));
+			thread_heap_allocator_func(nullptr, M::Free, old_ptr, old_size, 0, align, nullptr);
+		}
+		return res;
+	}
+	}
+
+	res.error = MemoryError::UnknownMode;
+	return res;
+}
+
+Allocator thread_heap_allocator(){
+	return Allocator{
+		.data = nullptr,
+		.func = thread_heap_allocator_func,
+	};
+}
@@ -0,0 +1,470 @@
+#include "base.hpp"
+
+constexpr isize tlsf_header_size = offsetof(TlsfBlock, next_free);
+constexpr isize tlsf_min_payload = sizeof(TlsfBlock) - tlsf_header_size;
+
+constexpr isize tlsf_flag_free      = 1 << 0;
+constexpr isize tlsf_flag_prev_free = 1 << 1;
+constexpr isize tlsf_flag_mask      = tlsf_flag_free | tlsf_flag_prev_free;
+
+static_assert(tlsf_header_size % tlsf_align == 0, "Block header must preserve alignment");
+static_assert(tlsf_fl_count <= 32, "First level bitmap does not fit in 32 bits");
+
+static inline
+isize block_size(TlsfBlock* b){
+	return b->size & ~tlsf_flag_mask;
+}
+
+static inline
+void block_set_size(TlsfBlock* b, isize size){
+	b->size = size | (b->size & tlsf_flag_mask);
+}
+
+static inline
+bool block_is_free(TlsfBlock* b){
+	return (b->size & tlsf_flag_free) != 0;
+}
+
+static inline
+void* block_payload(TlsfBlock* b){
+	return (u8*)b + tlsf_header_size;
+}
+
+static inline
+TlsfBlock* block_from_payload(void* p){
+	return (TlsfBlock*)((u8*)p - tlsf_header_size);
+}
+
+static inline
+TlsfBlock* block_next(TlsfBlock* b){
+	return (TlsfBlock*)((u8*)block_payload(b) + block_size(b));
+}
+
+static inline
+i32 bit_fls(u64 x){
+	return 63 - __builtin_clzll(x);
+}
+
+static inline
+i32 bit_ffs(u32 x){
+	return __builtin_ctz(x);
+}
+
+static inline
+void mapping_insert(isize size, i32* fl, i32* sl){
+	if(size < (isize(1) << tlsf_fl_shift)){
+		*fl = 0;
+		*sl = i32(size / ((isize(1) << tlsf_fl_shift) / tlsf_sl_count));
+	}
+	else {
+		i32 f = bit_fls(u64(size));
+		*sl = i32((size >> (f - tlsf_sl_count_log2)) ^ tlsf_sl_count);
+		*fl = f - (tlsf_fl_shift - 1);
+	}
+}
+
+// Round size up to the next size class, so any block found in its list fits
+static inline
+isize mapping_round(isize size){
+	if(size >= (isize(1) << tlsf_fl_shift)){
+		size += (isize(1) << (bit_fls(u64(size)) - tlsf_sl_count_log2)) - 1;
+	}
+	return size;
+}
+
+static
+void insert_free(Tlsf* t, TlsfBlock* b){
+	i32 fl, sl;
+	mapping_insert(block_size(b), &fl, &sl);
+
+	TlsfBlock* head = t->free_blocks[fl][sl];
+	b->next_free = head;
+	b->prev_free = nullptr;
+	if(head != nullptr){
+		head->prev_free = b;
+	}
+	t->free_blocks[fl][sl] = b;
+	t->fl_bitmap |= u32(1) << fl;
+	t->sl_bitmap[fl] |= u32(1) << sl;
+}
+
+static
+void remove_free(Tlsf* t, TlsfBlock* b){
+	i32 fl, sl;
+	mapping_insert(block_size(b), &fl, &sl);
+
+	if(b->prev_free != nullptr){
+		b->prev_free->next_free = b->next_free;
+	}
+	if(b->next_free != nullptr){
+		b->next_free->prev_free = b->prev_free;
+	}
+
+	if(t->free_blocks[fl][sl] == b){
+		t->free_blocks[fl][sl] = b->next_free;
+		if(b->next_free == nullptr){
+			t->sl_bitmap[fl] &= ~(u32(1) << sl);
+			if(t->sl_bitmap[fl] == 0){
+				t->fl_bitmap &= ~(u32(1) << fl);
+			}
+		}
+	}
+}
+
+// Find and unlink a free block with a payload of at least `size`
+static
+TlsfBlock* find_free(Tlsf* t, isize size){
+	i32 fl, sl;
+	mapping_insert(mapping_round(size), &fl, &sl);
+	if(fl >= tlsf_fl_count){
+		return nullptr;
+	}
+
+	u32 sl_map = t->sl_bitmap[fl] & (~u32(0) << sl);
+	if(sl_map == 0){
+		u32 fl_map = (fl + 1 < 32) ? (t->fl_bitmap & (~u32(0) << (fl + 1))) : 0;
+		if(fl_map == 0){
+			return nullptr;
+		}
+		fl = bit_ffs(fl_map);
+		sl_map = t->sl_bitmap[fl];
+	}
+	sl = bit_ffs(sl_map);
+
+	TlsfBlock* b = t->free_blocks[fl][sl];
+	remove_free(t, b);
+	return b;
+}
+
+static
+TlsfBlock* merge_prev(Tlsf* t, TlsfBlock* b){
+	if((b->size & tlsf_flag_prev_free) == 0){
+		return b;
+	}
+
+	TlsfBlock* prev = b->prev_phys;
+	remove_free(t, prev);
+	block_set_size(prev, block_size(prev) + tlsf_header_size + block_size(b));
+	if(b == t->last){
+		t->last = prev;
+	} else {
+		block_next(prev)->prev_phys = prev;
+	}
+	return prev;
+}
+
+static
+void merge_next(Tlsf* t, TlsfBlock* b){
+	if(b == t->last){ return; }
+
+	TlsfBlock* next = block_next(b);
+	if(!block_is_free(next)){ return; }
+
+	remove_free(t, next);
+	block_set_size(b, block_size(b) + tlsf_header_size + block_size(next));
+	if(next == t->last){
+		t->last = b;
+	} else {
+		block_next(b)->prev_phys = b;
+	}
+}
+
+// Give committed memory at the end of the last block back to the OS
+static
+void trim_last(Tlsf* t, TlsfBlock* b){
+	if(block_size(b) < tlsf_trim_threshold){ return; }
+
+	isize payload_offset = (u8*)block_payload(b) - (u8*)t->data.pointer;
+	t->data.pop(block_size(b) - tlsf_min_payload);
+	block_set_size(b, t->data.commited - payload_offset);
+}
+
+// Mark block as free, coalesce it with its neighbours and put it in a free list
+static
+void release_block(Tlsf* t, TlsfBlock* b){
+	b = merge_prev(t, b);
+	merge_next(t, b);
+
+	b->size |= tlsf_flag_free;
+	if(b == t->last){
+		trim_last(t, b);
+	} else {
+		TlsfBlock* next = block_next(b);
+		next->size |= tlsf_flag_prev_free;
+		next->prev_phys = b;
+	}
+	insert_free(t, b);
+}
+
+// Shrink a used block down to `size`, releasing the remainder if it is large
+// enough to hold a block of its own
+static
+void split_block(Tlsf* t, TlsfBlock* b, isize size){
+	isize rem_size = block_size(b) - size - tlsf_header_size;
+	if(rem_size < tlsf_min_payload){ return; }
+
+	auto rem = (TlsfBlock*)((u8*)block_payload(b) + size);
+	rem->prev_phys = b;
+	rem->size = rem_size;
+	block_set_size(b, size);
+
+	if(b == t->last){
+		t->last = rem;
+	} else {
+		block_next(rem)->prev_phys = rem;
+	}
+	release_block(t, rem);
+}
+
+static
+void use_block(Tlsf* t, TlsfBlock* b, isize size){
+	b->size &= ~tlsf_flag_free;
+	split_block(t, b, size);
+	if(b != t->last){
+		block_next(b)->size &= ~tlsf_flag_prev_free;
+	}
+}
+
+// Commit more memory so the last block is free and has at least `size` bytes of payload
+static
+bool grow(Tlsf* t, isize size){
+	TlsfBlock* last = t->last;
+	bool extend = last != nullptr && block_is_free(last);
+
+	isize before = t->data.commited;
+	isize wanted = extend ? (size - block_size(last)) : (size + tlsf_header_size);
+	if(t->data.push(wanted) == nullptr){
+		return false;
+	}
+	isize added = t->data.commited - before;
+
+	if(extend){
+		remove_free(t, last);
+		block_set_size(last, block_size(last) + added);
+		insert_free(t, last);
+	}
+	else {
+		auto b = (TlsfBlock*)((u8*)t->data.pointer + before);
+		b->prev_phys = last;
+		b->size = (added - tlsf_header_size) | tlsf_flag_free;
+		t->last = b;
+		insert_free(t, b);
+	}
+	return true;
+}
+
+void* Tlsf::alloc_non_zeroed(isize nbytes, isize align){
+	ensure(mem_valid_alignment(align), "Alignment must be a power of 2");
+	isize size = mem_align_forward_size(max(nbytes, tlsf_min_payload), tlsf_align);
+
+	// Over-aligned allocations need room to split off a free block in front
+	bool over_aligned = align > tlsf_align;
+	isize search = over_aligned ? (size + align + tlsf_header_size + tlsf_min_payload) : size;
+
+	TlsfBlock* b = find_free(this, search);
+	if(b == nullptr){
+		if(!grow(this, mapping_round(search))){
+			return nullptr; /* Out of memory */
+		}
+		b = find_free(this, search);
+		if(b == nullptr){
+			return nullptr;
+		}
+	}
+
+	if(over_aligned){
+		uintptr p = uintptr(block_payload(b));
+		uintptr aligned = mem_align_forward_ptr(p, align);
+		if(aligned != p && (aligned - p) < uintptr(tlsf_header_size + tlsf_min_payload)){
+			aligned = mem_align_forward_ptr(p + tlsf_header_size + tlsf_min_payload, align);
+		}
+
+		isize gap = aligned - p;
+		if(gap > 0){
+			auto nb = (TlsfBlock*)(aligned - tlsf_header_size);
+			nb->prev_phys = b;
+			nb->size = (block_size(b) - gap) | tlsf_flag_prev_free;
+			if(b == last){
+				last = nb;
+			} else {
+				block_next(nb)->prev_phys = nb;
+			}
+
+			block_set_size(b, gap - tlsf_header_size);
+			b->size |= tlsf_flag_free;
+			insert_free(this, b);
+			b = nb;
+		}
+	}
+
+	use_block(this, b, size);
+	return block_payload(b);
+}
+
+void* Tlsf::alloc(isize nbytes, isize align){
+	void* p = this->alloc_non_zeroed(nbytes, align);
+	if(p != nullptr){
+		mem_set(p, 0, nbytes);
+	}
+	return p;
+}
+
+void* Tlsf::resize_in_place(void* ptr, isize new_size){
+	if(ptr == nullptr){ return nullptr; }
+
+	TlsfBlock* b = block_from_payload(ptr);
+	debug_assert(!block_is_free(b), "Resizing freed pointer");
+	isize size = mem_align_forward_size(max(new_size, tlsf_min_payload), tlsf_align);
+	isize current = block_size(b);
+
+	if(size <= current){
+		split_block(this, b, size);
+		return ptr;
+	}
+
+	// Try to take over the next block, growing the heap if it is the last one
+	TlsfBlock* next = (b != last) ? block_next(b) : nullptr;
+	bool next_free = next != nullptr && block_is_free(next);
+	isize available = current + (next_free ? tlsf_header_size + block_size(next) : 0);
+
+	if(available < size){
+		bool at_end = (b == last) || (next_free && next == last);
+		if(!at_end || !grow(this, max(size - current - tlsf_header_size, tlsf_min_payload))){
+			return nullptr;
+		}
+	}
+
+	merge_next(this, b);
+	use_block(this, b, size);
+	return ptr;
+}
+
+void* Tlsf::realloc(void* ptr, isize old_size, isize new_size, isize align){
+	if(ptr == nullptr){
+		return this->alloc_non_zeroed(new_size, align);
+	}
+
+	if((uintptr(ptr) & uintptr(align - 1)) == 0 && this->resize_in_place(ptr, new_size) != nullptr){
+		return ptr;
+	}
+
+	void* new_ptr = this->alloc_non_zeroed(new_size, align);
+	if(new_ptr != nullptr){
+		mem_copy_no_overlap(new_ptr, ptr, min(old_size, new_size));
+		this->free(ptr);
+	}
+	return new_ptr;
+}
+
+void Tlsf::free(void* ptr){
+	if(ptr == nullptr){ return; }
+
+	TlsfBlock* b = block_from_payload(ptr);
+	debug_assert(!block_is_free(b), "Double free");
+	release_block(this, b);
+}
+
+void Tlsf::free_all(){
+	fl_bitmap = 0;
+	mem_set(sl_bitmap, 0, sizeof(sl_bitmap));
+	mem_set(free_blocks, 0, sizeof(free_blocks));
+	last = nullptr;
+
+	if(data.commited > 0){
+		auto b = (TlsfBlock*)data.pointer;
+		b->prev_phys = nullptr;
+		b->size = (data.commited - tlsf_header_size) | tlsf_flag_free;
+		last = b;
+		trim_last(this, b);
+		insert_free(this, b);
+	}
+}
+
+void Tlsf::destroy(){
+	data.destroy();
+	data = {};
+	last = nullptr;
+}
+
+Tlsf Tlsf::make(isize reserve){
+	Tlsf t = {};
+	t.data = PageBlock::make(reserve);
+	return t;
+}
+
+static
+Result<void*, MemoryError> tlsf_allocator_func(
+	void* impl,
+	AllocatorMode op,
+	void* old_ptr,
+	isize old_size,
+	isize size,
+	isize align,
+	u32* capabilities
+){
+	auto tlsf = (Tlsf*)impl;
+	using M = AllocatorMode;
+	using C = AllocatorCapability;
+
+	Result<void*, MemoryError> res;
+
+	switch (op) {
+	case M::Query: {
+		*capabilities = u32(C::AllocAny) | u32(C::FreeAny) | u32(C::FreeAll) | u32(C::Resize) | u32(C::AlignAny);
+		return res;
+	}
+
+	case M::Alloc: {
+		res.value = tlsf->alloc(size, align);
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+
+	case M::AllocNonZeroed: {
+		res.value = tlsf->alloc_non_zeroed(size, align);
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+
+	case M::Resize: {
+		res.value = tlsf->resize_in_place(old_ptr, size);
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::ResizeFailed;
+		}
+		return res;
+	}
+
+	case M::Free: {
+		tlsf->free(old_ptr);
+		return res;
+	}
+
+	case M::FreeAll: {
+		tlsf->free_all();
+		return res;
+	}
+
+	case M::Realloc: {
+		res.value = tlsf->realloc(old_ptr, old_size, size, align);
+		[[unlikely]] if(!res.value){
+			res.error = MemoryError::OutOfMemory;
+		}
+		return res;
+	}
+	}
+
+	res.error = MemoryError::UnknownMode;
+	return res;
+}
+
+Allocator Tlsf::as_allocator(){
+	Allocator alloc = {
+		.data = this,
+		.func = tlsf_allocator_func,
+	};
+	return alloc;
+}
@@ -0,0 +1,221 @@
+#include "base.hpp"
+
+#ifndef NO_STDIO
+#include <stdio.h>
+#endif
+
+static inline
+isize size_bucket(isize size){
+	if(size <= 1){ return 0; }
+	isize bucket = 64 - __builtin_clzll(u64(size - 1));
+	return min(bucket, tracking_histogram_buckets - 1);
+}
+
+static
+void stats_record(TrackingStats* stats, AllocatorMode op, isize old_size, isize size, bool failed){
+	using M = AllocatorMode;
+	isize mode = isize(op);
+	if(mode < 0 || mode >= allocator_mode_count){ return; }
+
+	stats->count[mode] += 1;
+	if(failed){
+		stats->failures += 1;
+		return;
+	}
+
+	switch(op){
+	case M::Alloc:
+	case M::AllocNonZeroed:
+		stats->bytes[mode] += size;
+		stats->histogram[mode][size_bucket(size)] += 1;
+		stats->live_bytes += size;
+		break;
+	case M::Resize:
+	case M::Realloc:
+		stats->bytes[mode] += size;
+		stats->histogram[mode][size_bucket(size)] += 1;
+		stats->live_bytes += size - old_size;
+		break;
+	case M::Free:
+		stats->bytes[mode] += old_size;
+		stats->histogram[mode][size_bucket(old_size)] += 1;
+		stats->live_bytes -= old_size;
+		break;
+	case M::FreeAll:
+		stats->live_bytes = 0;
+		break;
+	case M::Query:
+		break;
+	}
+	stats->peak_live_bytes = max(stats->peak_live_bytes, stats->live_bytes);
+}
+
+static
+Result<void*, MemoryError> tracking_forward(
+	TrackingAllocator* tracker,
+	TrackingSite* site,
+	AllocatorMode op,
+	void* old_ptr,
+	isize old_size,
+	isize size,
+	isize align,
+	u32* capabilities
+){
+	Allocator inner = tracker->inner;
+	auto res = inner.func(inner.data, op, old_ptr, old_size, size, align, capabilities);
+
+	// Allocators that don't know about AllocNonZeroed get a regular Alloc
+	if(op == AllocatorMode::AllocNonZeroed && res.error == MemoryError::UnknownMode){
+		op = AllocatorMode::Alloc;
+		res = inner.func(inner.data, op, old_ptr, old_size, size, align, capabilities);
+	}
+
+	bool failed = !ok(res);
+	stats_record(&tracker->stats, op, old_size, size, failed);
+	if(site != nullptr){
+		stats_record(&site->stats, op, old_size, size, failed);
+	}
+
+	if(op == AllocatorMode::FreeAll){
+		for(isize i = 0; i < tracker->site_count; i += 1){
+			tracker->sites[i]->stats.live_bytes = 0;
+		}
+	}
+	return res;
+}
+
+static
+Result<void*, MemoryError> tracking_allocator_func(
+	void* impl,
+	AllocatorMode op,
+	void* old_ptr,
+	isize old_size,
+	isize size,
+	isize align,
+	u32* capabilities
+){
+	auto tracker = (TrackingAllocator*)impl;
+	return tracking_forward(tracker, nullptr, op, old_ptr, old_size, size, align, capabilities);
+}
+
+static
+Result<void*, MemoryError> tracking_site_allocator_func(
+	void* impl,
+	AllocatorMode op,
+	void* old_ptr,
+	isize old_size,
+	isize size,
+	isize align,
+	u32* capabilities
+){
+	auto site = (TrackingSite*)impl;
+	return tracking_forward(site->parent, site, op, old_ptr, old_size, size, align, capabilities);
+}
+
+TrackingAllocator TrackingAllocator::make(Allocator inner){
+	TrackingAllocator t = {};
+	t.inner = inner;
+	return t;
+}
+
+Allocator TrackingAllocator::as_allocator(){
+	Allocator alloc = {
+		.data = this,
+		.func = tracking_allocator_func,
+	};
+	return alloc;
+}
+
+static
+bool same_location(std::source_location const& a, std::source_location const& b){
+	if(a.line() != b.line() || a.column() != b.column()){
+		return false;
+	}
+	return a.file_name() == b.file_name() || String(a.file_name()) == String(b.file_name());
+}
+
+Allocator TrackingAllocator::at(std::source_location location){
+	TrackingSite* site = nullptr;
+	for(isize i = 0; i < site_count; i += 1){
+		if(same_location(sites[i]->location, location)){
+			site = sites[i];
+			break;
+		}
+	}
+
+	if(site == nullptr){
+		if(site_count >= tracking_max_sites){
+			return this->as_allocator();
+		}
+		auto [p, err] = inner.alloc(sizeof(TrackingSite), alignof(TrackingSite));
+		if(!ok(err)){
+			return this->as_allocator();
+		}
+
+		site = (TrackingSite*)p;
+		site->location = location;
+		site->stats = {};
+		site->parent = this;
+		sites[site_count] = site;
+		site_count += 1;
+	}
+
+	Allocator alloc = {
+		.data = site,
+		.func = tracking_site_allocator_func,
+	};
+	return alloc;
+}
+
+TrackingStats TrackingAllocator::snapshot() const {
+	return stats;
+}
+
+void TrackingAllocator::reset(){
+	stats = {};
+	for(isize i = 0; i < site_count; i += 1){
+		sites[i]->stats = {};
+	}
+}
+
+void TrackingAllocator::destroy(){
+	for(isize i = 0; i < site_count; i += 1){
+		inner.free(sites[i], sizeof(TrackingSite), alignof(TrackingSite));
+	}
+	site_count = 0;
+}
+
+#ifndef NO_STDIO
+static
+void dump_stats(TrackingStats const& s){
+	static char const * const mode_names[allocator_mode_count] = {
+		"Query", "Alloc", "Resize", "Free", "FreeAll", "Realloc", "AllocNonZeroed",
+	};
+
+	fprintf(stderr, "  live: %lld bytes, peak: %lld bytes, failures: %lld\n",
+		(long long)s.live_bytes, (long long)s.peak_live_bytes, (long long)s.failures);
+
+	for(isize mode = 0; mode < allocator_mode_count; mode += 1){
+		if(s.count[mode] == 0){ continue; }
+		fprintf(stderr, "  %-15s calls: %-10lld bytes: %lld\n", mode_names[mode],
+			(long long)s.count[mode], (long long)s.bytes[mode]);
+
+		for(isize b = 0; b < tracking_histogram_buckets; b += 1){
+			if(s.histogram[mode][b] == 0){ continue; }
+			fprintf(stderr, "    <= %-12lld %lld\n", 1ll << b, (long long)s.histogram[mode][b]);
+		}
+	}
+}
+#endif
+
+void TrackingAllocator::dump() const {
+	#ifndef NO_STDIO
+	fprintf(stderr, "Allocator stats:\n");
+	dump_stats(stats);
+	for(isize i = 0; i < site_count; i += 1){
+		auto const& loc = sites[i]->location;
+		fprintf(stderr, "%s:%u:%u (%s):\n", loc.file_name(), loc.line(), loc.column(), loc.function_name());
+		dump_stats(sites[i]->stats);
+	}
+	#endif
+}
@@ -103,6 +103,12 @@ Utf8DecodeResult utf8_decode(Slice<byte> s){
 	if(res.codepoint >= UTF16_SURROGATE1 && res.codepoint <= UTF16_SURROGATE2){
 		return DECODE_ERROR;
 	}
+	if((res.len == 2 && res.codepoint <= RANGE1) ||
+	   (res.len == 3 && res.codepoint <= RANGE2) ||
+	   (res.len == 4 && (res.codepoint <= RANGE3 || res.codepoint > RANGE4)))
+	{
+		return DECODE_ERROR; /* Overlong or out of range */
+	}
 	if(res.len > 1 && !is_continuation_byte(buf[1])){
 		return DECODE_ERROR;
 	}
@@ -116,27 +122,904 @@ Utf8DecodeResult utf8_decode(Slice<byte> s){
 	return res;
 }
 
+// Length of the valid sequence starting at s[i] (which must not be ASCII), 0
+// if it is invalid or truncated
+static inline
+isize utf8_sequence_length(byte const* s, isize n, isize i){
+	u8 c = s[i];
+
+	// 0xc0 and 0xc1 can only start overlong 2 byte sequences, 0xf5 and up
+	// only sequences past U+10FFFF
+	isize len = (c >= 0xc2 && c < SIZE3) ? 2
+	          : (c >= SIZE3 && c < SIZE4) ? 3
+	          : (c >= SIZE4 && c < 0xf5) ? 4
+	          : 0;
+	if(len == 0 || i + len > n){ return 0; }
+
+	for(isize k = 1; k < len; k += 1){
+		if(!is_continuation_byte(s[i + k])){ return 0; }
+	}
+
+	// Second byte ranges that exclude overlongs, surrogates and values past U+10FFFF
+	u8 c1 = s[i + 1];
+	if((c == 0xe0 && c1 < 0xa0) ||
+	   (c == 0xed && c1 > 0x9f) ||
+	   (c == 0xf0 && c1 < 0x90) ||
+	   (c == 0xf4 && c1 > 0x8f))
+	{
+		return 0;
+	}
+	return len;
+}
+
+// Code point of a sequence already checked by utf8_sequence_length
+static inline
+rune utf8_sequence_value(byte const* p, isize len){
+	switch(len){
+	case 2:  return ((p[0] & MASK2) << 6) | (p[1] & MASKX);
+	case 3:  return ((p[0] & MASK3) << 12) | ((p[1] & MASKX) << 6) | (p[2] & MASKX);
+	default: return ((p[0] & MASK4) << 18) | ((p[1] & MASKX) << 12) | ((p[2] & MASKX) << 6) | (p[3] & MASKX);
+	}
+}
+
+static
+isize utf8_validate_scalar(byte const* s, isize n, isize i){
+	constexpr u64 high_bits = 0x8080808080808080ull;
+
+	while(i < n){
+		if(i + 8 <= n){
+			u64 w;
+			__builtin_memcpy(&w, &s[i], sizeof(w));
+			if((w & high_bits) == 0){
+				i += 8;
+				continue;
+			}
+		}
+
+		if(s[i] < CONT){
+			i += 1;
+			continue;
+		}
+
+		isize len = utf8_sequence_length(s, n, i);
+		if(len == 0){ return i; }
+		i += len;
+	}
+	return -1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Lookup table validation (Keiser & Lemire, "Validating UTF-8 In Less Than One
+// Instruction Per Byte"). Every byte pair is classified by three 16 entry
+// tables indexed by the high nibble of the previous byte, its low nibble, and
+// the high nibble of the current byte; their AND is non-zero exactly where the
+// pair can't occur. Missing or extra continuation bytes for 3 and 4 byte
+// sequences are checked by comparing against the bytes 2 and 3 back.
+constexpr u8 UTF8_TOO_SHORT      = 1 << 0;
+constexpr u8 UTF8_TOO_LONG       = 1 << 1;
+constexpr u8 UTF8_OVERLONG_3     = 1 << 2;
+constexpr u8 UTF8_TOO_LARGE      = 1 << 3;
+constexpr u8 UTF8_SURROGATE      = 1 << 4;
+constexpr u8 UTF8_OVERLONG_2     = 1 << 5;
+constexpr u8 UTF8_TOO_LARGE_1000 = 1 << 6;
+constexpr u8 UTF8_OVERLONG_4     = 1 << 6;
+constexpr u8 UTF8_TWO_CONTS      = 1 << 7;
+constexpr u8 UTF8_CARRY          = UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS;
+
+alignas(32) static const u8 utf8_byte_1_high[32] = {
+	// 0xxx (ASCII)
+	UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+	UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+	// 10xx (continuation)
+	UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+	// 1100, 1101 (2 byte lead)
+	UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+	UTF8_TOO_SHORT,
+	// 1110 (3 byte lead)
+	UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+	// 1111 (4 byte lead)
+	UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+	// Repeated for the upper 128-bit lane
+	UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+	UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+	UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+	UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+	UTF8_TOO_SHORT,
+	UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+	UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+};
+
+alignas(32) static const u8 utf8_byte_1_low[32] = {
+	UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4, // 0000
+	UTF8_CARRY | UTF8_OVERLONG_2,                                     // 0001
+	UTF8_CARRY,                                                       // 0010
+	UTF8_CARRY,                                                       // 0011
+	UTF8_CARRY | UTF8_TOO_LARGE,                                      // 0100
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                // 0101
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE, // 1101
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	// Repeated for the upper 128-bit lane
+	UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+	UTF8_CARRY | UTF8_OVERLONG_2,
+	UTF8_CARRY,
+	UTF8_CARRY,
+	UTF8_CARRY | UTF8_TOO_LARGE,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+};
+
+alignas(32) static const u8 utf8_byte_2_high[32] = {
+	// 0xxx (ASCII)
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+	// 1000
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+	// 1001
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+	// 101x
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+	// 11xx (lead)
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+	// Repeated for the upper 128-bit lane
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+};
+
+// Start of the sequence that contains `pos`, sequences are at most 4 bytes
+// long so this never goes back more than 3 bytes. Errors are only detected up
+// to 3 bytes after the sequence they belong to, so rescanning from the
+// sequence containing byte `i - 3` of the block where one was detected (or
+// the tail) finds it.
+static inline
+isize utf8_sequence_start(byte const* s, isize pos){
+	isize limit = max<isize>(pos - 3, 0);
+	while(pos > limit && is_continuation_byte(s[pos])){
+		pos -= 1;
+	}
+	return pos;
+}
+
+// Offset up to which `s` is known to be valid, at a sequence boundary. The
+// caller rescans from there with the scalar validator, which also handles the
+// tail and finds the exact position of an error.
+__attribute__((target("ssse3")))
+static
+isize utf8_validate_ssse3(byte const* s, isize n){
+	using simd::u8x16;
+	using c8x16 = VECTOR_DECL(char, 16);
+
+	u8x16 byte_1_high, byte_1_low, byte_2_high;
+	__builtin_memcpy(&byte_1_high, utf8_byte_1_high, 16);
+	__builtin_memcpy(&byte_1_low,  utf8_byte_1_low,  16);
+	__builtin_memcpy(&byte_2_high, utf8_byte_2_high, 16);
+
+	// Last bytes that leave a sequence unfinished at the end of a block
+	u8x16 max_complete = {
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1,
+	};
+
+	u8x16 prev_input = {};
+	u8x16 prev_incomplete = {};
+	isize i = 0;
+	for(; i + 16 <= n; i += 16){
+		u8x16 input = simd::load_u8x16(&s[i]);
+		u8x16 error;
+
+		// An ASCII block can't finish a sequence left open by the previous one,
+		// otherwise the lookups below catch that case
+		if(simd::movemask(input) == 0){
+			error = prev_incomplete;
+		}
+		else {
+			u8x16 prev1 = __builtin_shuffle(prev_input, input, u8x16{15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30});
+			u8x16 prev2 = __builtin_shuffle(prev_input, input, u8x16{14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29});
+			u8x16 prev3 = __builtin_shuffle(prev_input, input, u8x16{13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28});
+
+			u8x16 special = (u8x16)__builtin_ia32_pshufb128((c8x16)byte_1_high, (c8x16)(prev1 >> 4))
+			              & (u8x16)__builtin_ia32_pshufb128((c8x16)byte_1_low,  (c8x16)(prev1 & 0x0f))
+			              & (u8x16)__builtin_ia32_pshufb128((c8x16)byte_2_high, (c8x16)(input >> 4));
+
+			u8x16 must_be_cont = (u8x16)((prev2 >= 0xe0) | (prev3 >= 0xf0)) & 0x80;
+			error = must_be_cont ^ special;
+		}
+
+		prev_incomplete = (u8x16)(input > max_complete);
+		prev_input = input;
+
+		simd::u64x2 lanes = (simd::u64x2)error;
+		if((lanes[0] | lanes[1]) != 0){
+			break;
+		}
+	}
+	return utf8_sequence_start(s, max<isize>(i - 3, 0));
+}
+
+__attribute__((target("avx2")))
+static
+isize utf8_validate_avx2(byte const* s, isize n){
+	using simd::u8x32;
+	using c8x32 = VECTOR_DECL(char, 32);
+
+	u8x32 byte_1_high, byte_1_low, byte_2_high;
+	__builtin_memcpy(&byte_1_high, utf8_byte_1_high, 32);
+	__builtin_memcpy(&byte_1_low,  utf8_byte_1_low,  32);
+	__builtin_memcpy(&byte_2_high, utf8_byte_2_high, 32);
+
+	u8x32 max_complete;
+	mem_set(&max_complete, 0xff, sizeof(max_complete));
+	max_complete[29] = 0xf0 - 1;
+	max_complete[30] = 0xe0 - 1;
+	max_complete[31] = 0xc0 - 1;
+
+	u8x32 prev_input = {};
+	u8x32 prev_incomplete = {};
+	isize i = 0;
+	for(; i + 32 <= n; i += 32){
+		u8x32 input;
+		__builtin_memcpy(&input, &s[i], sizeof(input));
+		u8x32 error;
+
+		if(__builtin_ia32_pmovmskb256((c8x32)input) == 0){
+			error = prev_incomplete;
+		}
+		else {
+			u8x32 prev1 = __builtin_shuffle(prev_input, input, u8x32{
+				31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46,
+				47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62});
+			u8x32 prev2 = __builtin_shuffle(prev_input, input, u8x32{
+				30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45,
+				46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61});
+			u8x32 prev3 = __builtin_shuffle(prev_input, input, u8x32{
+				29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44,
+				45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60});
+
+			// pshufb looks up within each 128-bit lane, hence the duplicated tables
+			u8x32 special = (u8x32)__builtin_ia32_pshufb256((c8x32)byte_1_high, (c8x32)(prev1 >> 4))
+			              & (u8x32)__builtin_ia32_pshufb256((c8x32)byte_1_low,  (c8x32)(prev1 & 0x0f))
+			              & (u8x32)__builtin_ia32_pshufb256((c8x32)byte_2_high, (c8x32)(input >> 4));
+
+			u8x32 must_be_cont = (u8x32)((prev2 >= 0xe0) | (prev3 >= 0xf0)) & 0x80;
+			error = must_be_cont ^ special;
+		}
+
+		prev_incomplete = (u8x32)(input > max_complete);
+		prev_input = input;
+
+		if(__builtin_ia32_pmovmskb256((c8x32)(error != 0)) != 0){
+			break;
+		}
+	}
+	return utf8_sequence_start(s, max<isize>(i - 3, 0));
+}
+#endif
+
+isize utf8_validate(Slice<byte> buf){
+	byte const* s = buf.raw_data();
+	isize n = buf.len();
+	isize start = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if(n >= 32 && __builtin_cpu_supports("avx2")){
+		start = utf8_validate_avx2(s, n);
+	}
+	else if(n >= 16 && __builtin_cpu_supports("ssse3")){
+		start = utf8_validate_ssse3(s, n);
+	}
+#endif
+
+	return utf8_validate_scalar(s, n, start);
+}
+
+// Bytes that are not continuation bytes are counted 16 at a time, bytes that
+// start 4 byte sequences are counted again when `count_4byte_leads` is set
+template<bool count_4byte_leads>
+static
+isize utf8_count_leads(byte const* s, isize n){
+	using simd::i8x16;
+	using simd::u8x16;
+	isize count = 0;
+	isize i = 0;
+
+	// Continuation bytes are exactly the ones below -64 when read as signed.
+	// Matches are counted per lane in 8 bits, so lanes are summed up before
+	// they can overflow.
+	constexpr isize max_blocks = count_4byte_leads ? 127 : 255;
+	while(i + 16 <= n){
+		u8x16 acc = {};
+		isize blocks = min(max_blocks, (n - i) / 16);
+		for(isize b = 0; b < blocks; b += 1){
+			i8x16 v;
+			__builtin_memcpy(&v, &s[i], sizeof(v));
+			acc -= (u8x16)(v > -65);
+			if constexpr(count_4byte_leads){
+				acc -= (u8x16)((u8x16)v >= SIZE4);
+			}
+			i += 16;
+		}
+		for(isize k = 0; k < 16; k += 1){
+			count += acc[k];
+		}
+	}
+
+	for(; i < n; i += 1){
+		count += isize(!is_continuation_byte(s[i]));
+		if constexpr(count_4byte_leads){
+			count += isize(s[i] >= SIZE4);
+		}
+	}
+	return count;
+}
+
+isize utf8_rune_count(Slice<byte> buf){
+	return utf8_count_leads<false>(buf.raw_data(), buf.len());
+}
+
+isize utf16_length_from_utf8(Slice<byte> buf){
+	return utf8_count_leads<true>(buf.raw_data(), buf.len());
+}
+
+isize utf8_length_from_utf16(Slice<u16> buf){
+	u16 const* s = buf.raw_data();
+	isize count = 0;
+	for(isize i = 0; i < buf.len(); i += 1){
+		u16 c = s[i];
+		count += (c <= RANGE1) ? 1
+		       : (c <= RANGE2) ? 2
+		       : (c >= UTF16_SURROGATE1 && c <= UTF16_SURROGATE2) ? 2 // Half of a 4 byte sequence
+		       : 3;
+	}
+	return count;
+}
+
+isize utf8_length_from_utf32(Slice<rune> buf){
+	rune const* s = buf.raw_data();
+	isize count = 0;
+	for(isize i = 0; i < buf.len(); i += 1){
+		rune c = s[i];
+		count += (c <= RANGE1) ? 1
+		       : (c <= RANGE2) ? 2
+		       : (c <= RANGE3) ? 3
+		       : 4;
+	}
+	return count;
+}
+
+static inline
+TranscodeResult transcode_result(isize written, isize position, TranscodeError error){
+	return TranscodeResult{ .written = written, .position = position, .error = error };
+}
+
+// Widen 16 ASCII bytes to UTF-16 code units
+static inline
+void ascii_to_utf16_block(byte const* s, u16* out){
+	using u8x8  = VECTOR_DECL(u8, 8);
+	using u16x8 = simd::u16x8;
+	u8x8 lo, hi;
+	__builtin_memcpy(&lo, s, 8);
+	__builtin_memcpy(&hi, s + 8, 8);
+	u16x8 wide_lo = __builtin_convertvector(lo, u16x8);
+	u16x8 wide_hi = __builtin_convertvector(hi, u16x8);
+	__builtin_memcpy(out, &wide_lo, sizeof(wide_lo));
+	__builtin_memcpy(out + 8, &wide_hi, sizeof(wide_hi));
+}
+
+// Widen 16 ASCII bytes to UTF-32 code units
+static inline
+void ascii_to_utf32_block(byte const* s, rune* out){
+	using u8x4 = VECTOR_DECL(u8, 4);
+	for(isize k = 0; k < 16; k += 4){
+		u8x4 v;
+		__builtin_memcpy(&v, s + k, 4);
+		simd::i32x4 wide = __builtin_convertvector(v, simd::i32x4);
+		__builtin_memcpy(out + k, &wide, sizeof(wide));
+	}
+}
+
+// Bytes a block kernel may read past the 16 it decodes, the sequences
+// starting in the last two positions can end there
+constexpr isize utf8_block_lookahead = 2;
+
+// Byte shuffles that move the 16-bit lanes selected by an 8 bit mask to the
+// front of a vector, used to drop the values at continuation positions
+struct Utf16CompactTable {
+	u8 index[256][16];
+};
+
+static constexpr Utf16CompactTable make_utf16_compact_table(){
+	Utf16CompactTable t = {};
+	for(u32 mask = 0; mask < 256; mask += 1){
+		u32 k = 0;
+		for(u32 lane = 0; lane < 8; lane += 1){
+			if(mask & (1u << lane)){
+				t.index[mask][k + 0] = u8(2 * lane);
+				t.index[mask][k + 1] = u8(2 * lane + 1);
+				k += 2;
+			}
+		}
+	}
+	return t;
+}
+
+alignas(16) static constexpr Utf16CompactTable utf16_compact_table = make_utf16_compact_table();
+
+// Variable byte shuffles are a single instruction with SSSE3 (pshufb, x86
+// dispatches to it at runtime) or NEON (tbl), elsewhere a loop over the mask
+// is cheaper
+#if defined(__aarch64__) || defined(__ARM_NEON)
+constexpr bool utf8_native_byte_shuffle = true;
+#else
+constexpr bool utf8_native_byte_shuffle = false;
+#endif
+
+// Decode a block of 1 to 3 byte sequences starting at `s`, reading 18 bytes.
+// Every sequence starting in the first 16 bytes is validated and written to
+// `out` (at most 16 units), `consumed` gets the number of input bytes used.
+// Returns the number of units written, or -1 if the block has anything else
+// (4 byte sequences, invalid bytes) for the scalar path to deal with.
+// With `byte_shuffle` the values are compacted with table driven shuffles,
+// which store a full 16 units.
+template<typename Unit, bool byte_shuffle>
+[[gnu::always_inline]] static inline
+isize utf8_bmp_block(byte const* s, Unit* out, isize* consumed){
+	using simd::u8x16;
+	using simd::movemask;
+	using u16x16 = simd::u16x16;
+	using i16x16 = simd::i16x16;
+
+	u8x16 b0 = simd::load_u8x16(s);
+	u8x16 b1 = simd::load_u8x16(s + 1);
+	u8x16 b2 = simd::load_u8x16(s + 2);
+
+	u32 ge_f0 = movemask((u8x16)(b0 >= 0xf0));
+	if(ge_f0 != 0){ return -1; }
+
+	u32 cont  = movemask((u8x16)((b0 & 0xc0) == CONT));
+	u32 cont1 = movemask((u8x16)((b1 & 0xc0) == CONT));
+	u32 cont2 = movemask((u8x16)((b2 & 0xc0) == CONT));
+	u32 lead3 = movemask((u8x16)(b0 >= SIZE3));
+	u32 lead2 = movemask((u8x16)(b0 >= SIZE2)) & ~lead3;
+
+	// Same rules as utf8_sequence_length: overlong 2 byte leads, overlong and
+	// surrogate 3 byte sequences, and every continuation byte must belong to
+	// a lead in this block
+	u32 b1_low   = movemask((u8x16)(b1 < 0xa0));
+	u32 overlong = movemask((u8x16)((b0 & 0xfe) == SIZE2)) | (movemask((u8x16)(b0 == 0xe0)) & b1_low);
+	u32 surrogate = movemask((u8x16)(b0 == 0xed)) & ~b1_low;
+	u32 claimed  = (((lead2 | lead3) << 1) | (lead3 << 2)) & 0xffff;
+	u32 bad = overlong | surrogate | (lead2 & ~cont1) | (lead3 & ~(cont1 & cont2)) | (claimed ^ cont);
+	if(bad != 0){ return -1; }
+
+	u16x16 w0 = __builtin_convertvector(b0, u16x16);
+	u16x16 w1 = __builtin_convertvector(b1, u16x16) & MASKX;
+	u16x16 w2 = __builtin_convertvector(b2, u16x16) & MASKX;
+	u16x16 k2 = (u16x16)__builtin_convertvector((simd::i8x16)((b0 >= SIZE2) & (b0 < SIZE3)), i16x16);
+	u16x16 k3 = (u16x16)__builtin_convertvector((simd::i8x16)(b0 >= SIZE3), i16x16);
+
+	u16x16 v2 = ((w0 & MASK2) << 6) | w1;
+	u16x16 v3 = ((w0 & MASK3) << 12) | (w1 << 6) | w2;
+	u16x16 values = (w0 & ~(k2 | k3)) | (v2 & k2) | (v3 & k3);
+
+	// Keep the values at lead positions
+	u32 leads = ~cont & 0xffff;
+	isize last = 31 - __builtin_clz(leads);
+	*consumed = last + 1 + isize((lead2 >> last) & 1) + 2 * isize((lead3 >> last) & 1);
+
+	if constexpr(byte_shuffle){
+		simd::u16x8 halves[2] = {
+			__builtin_shufflevector(values, values, 0, 1, 2, 3, 4, 5, 6, 7),
+			__builtin_shufflevector(values, values, 8, 9, 10, 11, 12, 13, 14, 15),
+		};
+		isize o = 0;
+		for(i32 h = 0; h < 2; h += 1){
+			u32 mask = (leads >> (8 * h)) & 0xff;
+			u8x16 index;
+			__builtin_memcpy(&index, utf16_compact_table.index[mask], sizeof(index));
+			simd::u16x8 packed = (simd::u16x8)__builtin_shuffle((u8x16)halves[h], index);
+			if constexpr(sizeof(Unit) == 2){
+				__builtin_memcpy(&out[o], &packed, sizeof(packed));
+			}
+			else {
+				simd::u32x8 wide = __builtin_convertvector(packed, simd::u32x8);
+				__builtin_memcpy(&out[o], &wide, sizeof(wide));
+			}
+			o += __builtin_popcount(mask);
+		}
+		return o;
+	}
+	else {
+		u16 units[16];
+		__builtin_memcpy(units, &values, sizeof(units));
+		isize o = 0;
+		for(u32 m = leads; m != 0; m &= m - 1){
+			out[o] = Unit(units[__builtin_ctz(m)]);
+			o += 1;
+		}
+		return o;
+	}
+}
+
+// Encode 8 BMP code points as UTF-8. Writes up to 3 bytes per code point
+// unconditionally, so `out` needs 24 bytes of room. Returns the number of
+// bytes that are part of the output, or -1 if there are surrogates.
+static inline
+isize utf8_encode_bmp_block(simd::u16x8 v, byte* out){
+	using u16x8 = simd::u16x8;
+	using u8x8  = VECTOR_DECL(u8, 8);
+
+	u16x8 surrogate = (u16x8)((v & 0xf800) == UTF16_SURROGATE1);
+	simd::u64x2 any = (simd::u64x2)surrogate;
+	if((any[0] | any[1]) != 0){ return -1; }
+
+	u16x8 k2 = (u16x8)((v > RANGE1) & (v <= RANGE2));
+	u16x8 k3 = (u16x8)(v > RANGE2);
+	u16x8 k1 = ~(k2 | k3);
+
+	u16x8 low = CONT | (v & MASKX);
+	u16x8 mid = CONT | ((v >> 6) & MASKX);
+	u16x8 first  = (v & k1) | ((SIZE2 | (v >> 6)) & k2) | ((SIZE3 | (v >> 12)) & k3);
+	u16x8 second = (low & k2) | (mid & k3);
+	u16x8 length = 1 + (k2 & 1) + (k3 & 2);
+
+	u8x8 b0 = __builtin_convertvector(first, u8x8);
+	u8x8 b1 = __builtin_convertvector(second, u8x8);
+	u8x8 b2 = __builtin_convertvector(low, u8x8);
+	u8x8 len = __builtin_convertvector(length, u8x8);
+
+	isize o = 0;
+	for(isize k = 0; k < 8; k += 1){
+		out[o + 0] = b0[k];
+		out[o + 1] = b1[k];
+		out[o + 2] = b2[k];
+		o += len[k];
+	}
+	return o;
+}
+
+// Shared by utf8_to_utf16 and utf8_to_utf32, code points past the BMP become
+// surrogate pairs when `Unit` is 16 bits wide
+template<typename Unit, bool byte_shuffle>
+[[gnu::always_inline]] static inline
+TranscodeResult utf8_to_units(Slice<byte> src, Slice<Unit> dst){
+	byte const* s = src.raw_data();
+	Unit* out = dst.raw_data();
+	isize n = src.len();
+	isize cap = dst.len();
+	isize i = 0, o = 0;
+
+	while(i < n){
+		// 16 byte blocks, ASCII ones are widened directly, other BMP only ones
+		// decoded in bulk. Anything else takes one step of the scalar path.
+		while(i + 16 + utf8_block_lookahead <= n && o + 16 <= cap){
+			if(simd::movemask(simd::load_u8x16(&s[i])) == 0){
+				if constexpr(sizeof(Unit) == 2){
+					ascii_to_utf16_block(&s[i], &out[o]);
+				}
+				else {
+					ascii_to_utf32_block(&s[i], &out[o]);
+				}
+				i += 16;
+				o += 16;
+				continue;
+			}
+			isize consumed = 0;
+			isize written = utf8_bmp_block<Unit, byte_shuffle>(&s[i], &out[o], &consumed);
+			if(written < 0){ break; }
+			i += consumed;
+			o += written;
+		}
+		if(i >= n){ break; }
+
+		u8 c = s[i];
+		if(c < CONT){
+			if(o >= cap){ return transcode_result(o, i, TranscodeError::OutputTooSmall); }
+			out[o] = c;
+			i += 1;
+			o += 1;
+			continue;
+		}
+
+		isize len = utf8_sequence_length(s, n, i);
+		if(len == 0){ return transcode_result(o, i, TranscodeError::InvalidSequence); }
+
+		rune r = utf8_sequence_value(&s[i], len);
+		if(sizeof(Unit) == 4 || r <= RANGE3){
+			if(o >= cap){ return transcode_result(o, i, TranscodeError::OutputTooSmall); }
+			out[o] = Unit(r);
+			o += 1;
+		}
+		else {
+			if(o + 2 > cap){ return transcode_result(o, i, TranscodeError::OutputTooSmall); }
+			r -= 0x10000;
+			out[o + 0] = Unit(UTF16_SURROGATE1 + (r >> 10));
+			out[o + 1] = Unit(0xdc00 + (r & 0x3ff));
+			o += 2;
+		}
+		i += len;
+	}
+	return transcode_result(o, i, TranscodeError::None);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("ssse3")))
+static
+TranscodeResult utf8_to_utf16_ssse3(Slice<byte> src, Slice<u16> dst){
+	return utf8_to_units<u16, true>(src, dst);
+}
+
+__attribute__((target("ssse3")))
+static
+TranscodeResult utf8_to_utf32_ssse3(Slice<byte> src, Slice<rune> dst){
+	return utf8_to_units<rune, true>(src, dst);
+}
+#endif
+
+TranscodeResult utf8_to_utf16(Slice<byte> src, Slice<u16> dst){
+#if defined(__x86_64__) || defined(__i386__)
+	if(__builtin_cpu_supports("ssse3")){
+		return utf8_to_utf16_ssse3(src, dst);
+	}
+#endif
+	return utf8_to_units<u16, utf8_native_byte_shuffle>(src, dst);
+}
+
+TranscodeResult utf8_to_utf32(Slice<byte> src, Slice<rune> dst){
+#if defined(__x86_64__) || defined(__i386__)
+	if(__builtin_cpu_supports("ssse3")){
+		return utf8_to_utf32_ssse3(src, dst);
+	}
+#endif
+	return utf8_to_units<rune, utf8_native_byte_shuffle>(src, dst);
+}
+
+// Write `r` (a valid code point) as UTF-8, returns the number of bytes or 0
+// if it does not fit
+static inline
+isize utf8_put(byte* out, isize avail, rune r){
+	if(r <= RANGE1){
+		if(avail < 1){ return 0; }
+		out[0] = byte(r);
+		return 1;
+	}
+	if(r <= RANGE2){
+		if(avail < 2){ return 0; }
+		out[0] = byte(SIZE2 | (r >> 6));
+		out[1] = byte(CONT  | (r & MASKX));
+		return 2;
+	}
+	if(r <= RANGE3){
+		if(avail < 3){ return 0; }
+		out[0] = byte(SIZE3 | (r >> 12));
+		out[1] = byte(CONT  | ((r >> 6) & MASKX));
+		out[2] = byte(CONT  | (r & MASKX));
+		return 3;
+	}
+	if(avail < 4){ return 0; }
+	out[0] = byte(SIZE4 | (r >> 18));
+	out[1] = byte(CONT  | ((r >> 12) & MASKX));
+	out[2] = byte(CONT  | ((r >> 6) & MASKX));
+	out[3] = byte(CONT  | (r & MASKX));
+	return 4;
+}
+
+TranscodeResult utf16_to_utf8(Slice<u16> src, Slice<byte> dst){
+	using u8x8  = VECTOR_DECL(u8, 8);
+	using u16x8 = simd::u16x8;
+
+	u16 const* s = src.raw_data();
+	byte* out = dst.raw_data();
+	isize n = src.len();
+	isize cap = dst.len();
+	isize i = 0, o = 0;
+
+	while(i < n){
+		// 8 code units at a time, ASCII is narrowed directly and other
+		// blocks without surrogates are encoded in bulk
+		while(i + 8 <= n && o + 24 <= cap){
+			u16x8 v;
+			__builtin_memcpy(&v, &s[i], sizeof(v));
+			simd::u64x2 high = (simd::u64x2)(v & 0xff80);
+			if((high[0] | high[1]) == 0){
+				u8x8 narrow = __builtin_convertvector(v, u8x8);
+				__builtin_memcpy(&out[o], &narrow, sizeof(narrow));
+				i += 8;
+				o += 8;
+				continue;
+			}
+			isize written = utf8_encode_bmp_block(v, &out[o]);
+			if(written < 0){ break; }
+			i += 8;
+			o += written;
+		}
+		if(i >= n){ break; }
+
+		rune r = s[i];
+		isize units = 1;
+		if(r >= UTF16_SURROGATE1 && r <= UTF16_SURROGATE2){
+			// Must be a high surrogate followed by a low one
+			if(r > 0xdbff || i + 1 >= n || s[i + 1] < 0xdc00 || s[i + 1] > UTF16_SURROGATE2){
+				return transcode_result(o, i, TranscodeError::InvalidSequence);
+			}
+			r = 0x10000 + ((r - UTF16_SURROGATE1) << 10) + (s[i + 1] - 0xdc00);
+			units = 2;
+		}
+
+		isize len = utf8_put(&out[o], cap - o, r);
+		if(len == 0){ return transcode_result(o, i, TranscodeError::OutputTooSmall); }
+		i += units;
+		o += len;
+	}
+	return transcode_result(o, i, TranscodeError::None);
+}
+
+TranscodeResult utf32_to_utf8(Slice<rune> src, Slice<byte> dst){
+	using u8x4  = VECTOR_DECL(u8, 4);
+	using u16x4 = VECTOR_DECL(u16, 4);
+	using u32x4 = simd::u32x4;
+
+	rune const* s = src.raw_data();
+	byte* out = dst.raw_data();
+	isize n = src.len();
+	isize cap = dst.len();
+	isize i = 0, o = 0;
+
+	while(i < n){
+		// 8 code points at a time, ASCII is narrowed directly and other BMP
+		// blocks go through the UTF-16 block encoder
+		while(i + 8 <= n && o + 24 <= cap){
+			u32x4 lo, hi;
+			__builtin_memcpy(&lo, &s[i], sizeof(lo));
+			__builtin_memcpy(&hi, &s[i + 4], sizeof(hi));
+			simd::u64x2 ascii = (simd::u64x2)((lo | hi) & ~u32(RANGE1));
+			if((ascii[0] | ascii[1]) == 0){
+				u8x4 narrow_lo = __builtin_convertvector(lo, u8x4);
+				u8x4 narrow_hi = __builtin_convertvector(hi, u8x4);
+				__builtin_memcpy(&out[o], &narrow_lo, sizeof(narrow_lo));
+				__builtin_memcpy(&out[o + 4], &narrow_hi, sizeof(narrow_hi));
+				i += 8;
+				o += 8;
+				continue;
+			}
+			simd::u64x2 high = (simd::u64x2)((lo | hi) & ~u32(RANGE3));
+			if((high[0] | high[1]) != 0){ break; }
+			u16x4 narrow_lo = __builtin_convertvector(lo, u16x4);
+			u16x4 narrow_hi = __builtin_convertvector(hi, u16x4);
+			simd::u16x8 v = __builtin_shufflevector(narrow_lo, narrow_hi, 0, 1, 2, 3, 4, 5, 6, 7);
+			isize written = utf8_encode_bmp_block(v, &out[o]);
+			if(written < 0){ break; }
+			i += 8;
+			o += written;
+		}
+		if(i >= n){ break; }
+
+		rune r = s[i];
+		if(r < 0 || r > RANGE4 || (r >= UTF16_SURROGATE1 && r <= UTF16_SURROGATE2)){
+			return transcode_result(o, i, TranscodeError::InvalidSequence);
+		}
+
+		isize len = utf8_put(&out[o], cap - o, r);
+		if(len == 0){ return transcode_result(o, i, TranscodeError::OutputTooSmall); }
+		i += 1;
+		o += len;
+	}
+	return transcode_result(o, i, TranscodeError::None);
+}
+
+template<typename From, typename To>
+static
+Pair<Slice<To>, TranscodeResult> transcode_alloc(Slice<From> src, Allocator a, isize size,
+	TranscodeResult (*convert)(Slice<From>, Slice<To>))
+{
+	// Nothing to write, still run the conversion to report invalid input
+	if(size == 0){
+		return {Slice<To>(), convert(src, Slice<To>())};
+	}
+
+	auto [buf, error] = a.alloc_non_zeroed(size * sizeof(To), alignof(To));
+	if(!ok(error)){
+		return {Slice<To>(), transcode_result(0, 0, TranscodeError::OutOfMemory)};
+	}
+	auto out = Slice<To>((To*)buf, size);
+	auto res = convert(src, out);
+	if(res.error != TranscodeError::None){
+		a.free(buf, size * sizeof(To), alignof(To));
+		return {Slice<To>(), res};
+	}
+	return {Slice<To>((To*)buf, res.written), res};
+}
+
+Pair<Slice<u16>, TranscodeResult> utf8_to_utf16(Slice<byte> src, Allocator a){
+	return transcode_alloc(src, a, utf16_length_from_utf8(src), utf8_to_utf16);
+}
+
+Pair<Slice<rune>, TranscodeResult> utf8_to_utf32(Slice<byte> src, Allocator a){
+	return transcode_alloc(src, a, utf8_rune_count(src), utf8_to_utf32);
+}
+
+Pair<Slice<byte>, TranscodeResult> utf16_to_utf8(Slice<u16> src, Allocator a){
+	return transcode_alloc(src, a, utf8_length_from_utf16(src), utf16_to_utf8);
+}
+
+Pair<Slice<byte>, TranscodeResult> utf32_to_utf8(Slice<rune> src, Allocator a){
+	return transcode_alloc(src, a, utf8_length_from_utf32(src), utf32_to_utf8);
+}
+
 bool iter_next(Utf8Iterator* it, rune* r, i32* n){
-	if(it->current >= it->data.len()){ return 0; }
+	isize len = it->data.len();
+	if(it->current >= len){ return false; }
 
-	Utf8DecodeResult res = utf8_decode(it->data.slice_right(it->current));
+	byte* p = it->data.raw_data() + it->current;
+	[[likely]] if(*p < CONT){
+		*r = *p;
+		*n = 1;
+		it->current += 1;
+		return true;
+	}
+
+	Utf8DecodeResult res = utf8_decode(Slice<byte>(p, len - it->current));
 	*r = res.codepoint;
 	*n = res.len;
 
-	if(res.codepoint == DECODE_ERROR.codepoint){
+	// Skip a single byte of an invalid sequence
+	if(res.len == 0){
 		*n = 1;
 	}
+	it->current += *n;
+
+	return true;
+}
+
+Slice<byte> iter_next_ascii(Utf8Iterator* it){
+	byte* base = it->data.raw_data();
+	isize len = it->data.len();
+	isize start = it->current;
+	isize i = start;
 
-	it->current += res.len;
+	while(i + 16 <= len){
+		u32 mask = simd::movemask(simd::load_u8x16(&base[i]));
+		if(mask != 0){
+			i += __builtin_ctz(mask);
+			it->current = i;
+			return Slice<byte>(&base[start], i - start);
+		}
+		i += 16;
+	}
+	while(i < len && base[i] < CONT){
+		i += 1;
+	}
 
-	return 1;
+	it->current = i;
+	return Slice<byte>(&base[start], i - start);
 }
 
 bool iter_prev(Utf8Iterator* it, rune* r, i32* len){
 	if(it->current <= 0){ return false; }
 
 	it->current -= 1;
-	while(is_continuation_byte(it->data[it->current])){
+	while(it->current > 0 && is_continuation_byte(it->data[it->current])){
 		it->current -= 1;
 	}
 
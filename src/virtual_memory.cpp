@@ -1,12 +1,26 @@
 #include "base.hpp"
 
-PageBlock PageBlock::make(isize nbytes){
-	nbytes = mem_align_forward_size(nbytes, mem_page_size);
-	void* ptr = virtual_reserve(nbytes);
+PageBlock PageBlock::make(isize nbytes, isize commit_chunk, u32 flags){
+	isize granularity = virtual_page_size();
+	if(flags & (mem_page_huge | mem_page_huge_explicit)){
+		isize huge_size = (flags & mem_page_huge_explicit) ? virtual_explicit_huge_page_size() : virtual_huge_page_size();
+		if(huge_size > 0){
+			granularity = huge_size;
+		}
+		else if(flags & mem_page_huge_explicit){
+			return PageBlock{}; /* Huge pages not supported */
+		}
+	}
+
+	commit_chunk = mem_align_forward_size(max(commit_chunk, granularity), granularity);
+	nbytes = mem_align_forward_size(nbytes, commit_chunk);
+	void* ptr = virtual_reserve(nbytes, flags);
 	PageBlock blk = {
 		.reserved = (ptr != nullptr) ? nbytes : 0,
 		.commited = 0,
 		.pointer = ptr,
+		.commit_chunk = commit_chunk,
+		.flags = flags,
 	};
 	return blk;
 }
@@ -16,9 +30,14 @@ void PageBlock::destroy(){
 }
 
 void* PageBlock::push(isize nbytes){
-	nbytes = mem_align_forward_size(nbytes, mem_page_size);
+	isize in_reserve = reserved - commited;
+	if(nbytes > in_reserve){
+		return nullptr; /* Out of reserved memory */
+	}
+	nbytes = min(mem_align_forward_size(nbytes, commit_chunk), in_reserve);
+
 	u8* old_ptr = (u8*)pointer + commited;
-	void* new_ptr = virtual_commit(old_ptr, nbytes);
+	void* new_ptr = virtual_commit(old_ptr, nbytes, flags);
 
 	if(new_ptr == nullptr){
 		return nullptr; /* Memory error */
@@ -30,12 +49,11 @@ void* PageBlock::push(isize nbytes){
 void PageBlock::pop(isize nbytes){
 	nbytes = clamp<isize>(0, nbytes, commited);
 
-	uintptr base = (uintptr)pointer;
-	// Free pages *after* this location
-	uintptr free_after = base + (commited - nbytes);
-	free_after = mem_align_forward_ptr(free_after, mem_page_size);
+	// Free chunks *after* this location
+	isize keep = mem_align_forward_size(commited - nbytes, commit_chunk);
+	isize amount_to_free = commited - keep;
+	if(amount_to_free <= 0){ return; }
 
-	isize amount_to_free = (base + commited) - free_after;
-	virtual_decommit((void*)free_after, amount_to_free);
+	virtual_decommit((u8*)pointer + keep, amount_to_free);
 	commited -= amount_to_free;
 }
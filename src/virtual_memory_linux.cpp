@@ -5,10 +5,12 @@
 #include "base.hpp"
 #include <sys/mman.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 static inline
 bool valid_ptr_and_size(void* ptr, isize size){
-	return ((uintptr(ptr) & (mem_page_size - 1)) == 0) && ((size & (mem_page_size - 1)) == 0);
+	isize page_size = virtual_page_size();
+	return ((uintptr(ptr) & (page_size - 1)) == 0) && ((size & (page_size - 1)) == 0);
 }
 
 static inline
@@ -23,9 +25,110 @@ u32 protect_flags(u8 prot){
 	return flag;
 }
 
-void* virtual_reserve(isize nbytes){
-	nbytes = mem_align_forward_size(nbytes, mem_page_size);
+isize virtual_page_size(){
+	static const isize page_size = sysconf(_SC_PAGESIZE);
+	return page_size;
+}
+
+// Reads up to `cap - 1` bytes of a (small, procfs or sysfs) file, null terminated
+static
+isize read_small_file(char const* path, char* buf, isize cap){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0){ return 0; }
+
+	isize total = 0;
+	while(total < cap - 1){
+		isize n = read(fd, buf + total, cap - 1 - total);
+		if(n <= 0){ break; }
+		total += n;
+	}
+	close(fd);
+	buf[total] = 0;
+	return total;
+}
+
+static
+isize parse_decimal(char const* s){
+	while(*s == ' ' || *s == '\t'){ s += 1; }
+	isize v = 0;
+	for(; *s >= '0' && *s <= '9'; s += 1){
+		v = v * 10 + (*s - '0');
+	}
+	return v;
+}
+
+// Transparent huge pages are PMD sized
+static
+isize read_huge_page_size(){
+	char buf[32];
+	if(read_small_file("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", buf, sizeof(buf)) == 0){
+		return 0;
+	}
+	isize size = parse_decimal(buf);
+	return mem_valid_alignment(size) ? size : 0;
+}
+
+// MAP_HUGETLB uses the hugetlbfs default page size, which can differ from the
+// THP size (e.g. when booted with default_hugepagesz=1G)
+static
+isize read_hugetlb_page_size(){
+	char buf[4096];
+	if(read_small_file("/proc/meminfo", buf, sizeof(buf)) == 0){
+		return 0;
+	}
+	char const* line = __builtin_strstr(buf, "Hugepagesize:");
+	if(line == nullptr){ return 0; }
+	isize size = parse_decimal(line + sizeof("Hugepagesize:") - 1) * mem_KiB;
+	return mem_valid_alignment(size) ? size : 0;
+}
+
+isize virtual_huge_page_size(){
+	static const isize huge_page_size = read_huge_page_size();
+	return huge_page_size;
+}
+
+isize virtual_explicit_huge_page_size(){
+	static const isize huge_page_size = read_hugetlb_page_size();
+	return huge_page_size;
+}
+
+void* virtual_reserve(isize nbytes, u32 flags){
+	nbytes = mem_align_forward_size(nbytes, virtual_page_size());
+
+	if(flags & mem_page_huge_explicit){
+		isize huge_size = virtual_explicit_huge_page_size();
+		if(huge_size == 0){ return nullptr; }
+		// No MAP_NORESERVE: the pages are reserved from the hugetlb pool now, so
+		// mmap fails here instead of the first write raising SIGBUS later
+		nbytes = mem_align_forward_size(nbytes, huge_size);
+		void* ptr = mmap(NULL, nbytes, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+		return (ptr == MAP_FAILED) ? nullptr : ptr;
+	}
+
+	isize huge_size = (flags & mem_page_huge) ? virtual_huge_page_size() : 0;
+	if(huge_size > 0){
+		// Over-reserve so the range can be trimmed to a huge page boundary,
+		// otherwise the kernel can't back it with huge pages.
+		nbytes = mem_align_forward_size(nbytes, huge_size);
+		u8* ptr = (u8*)mmap(NULL, nbytes + huge_size, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+		if(ptr == MAP_FAILED){
+			return nullptr;
+		}
+
+		u8* aligned = (u8*)mem_align_forward_ptr(uintptr(ptr), huge_size);
+		isize head = aligned - ptr;
+		isize tail = huge_size - head;
+		if(head > 0){ munmap(ptr, head); }
+		if(tail > 0){ munmap(aligned + nbytes, tail); }
+
+		madvise(aligned, nbytes, MADV_HUGEPAGE);
+		return aligned;
+	}
+
 	void* ptr = mmap(NULL, nbytes, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if(ptr == MAP_FAILED){
+		return nullptr;
+	}
 	return ptr;
 }
 
@@ -34,12 +137,30 @@ void virtual_release(void* pointer, isize nbytes){
 	munmap(pointer, nbytes);
 }
 
-void* virtual_commit(void* pointer, isize nbytes){
+static
+void prefault_pages(void* pointer, isize nbytes){
+	#if defined(MADV_POPULATE_WRITE)
+	if(madvise(pointer, nbytes, MADV_POPULATE_WRITE) == 0){
+		return;
+	}
+	#endif
+	// Older kernels: touch every page, writing back what is already there
+	isize page_size = virtual_page_size();
+	volatile u8* p = (volatile u8*)pointer;
+	for(isize i = 0; i < nbytes; i += page_size){
+		p[i] = p[i];
+	}
+}
+
+void* virtual_commit(void* pointer, isize nbytes, u32 flags){
 	debug_assert(valid_ptr_and_size(pointer, nbytes), "Pointer and allocation size must be page aligned");
 	if(mprotect(pointer, nbytes, PROT_READ | PROT_WRITE) < 0){
 		return NULL;
 	}
-	return pointer;	
+	if(flags & mem_page_prefault){
+		prefault_pages(pointer, nbytes);
+	}
+	return pointer;
 }
 
 void virtual_decommit(void* pointer, isize nbytes){
@@ -53,4 +174,3 @@ bool virtual_protect(void* pointer, isize nbytes, u8 prot){
 	u32 flags = protect_flags(prot);
 	return mprotect(pointer, nbytes, flags) >= 0;
 }
-
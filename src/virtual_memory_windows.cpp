@@ -6,11 +6,37 @@ extern "C" {
 
 static inline
 bool valid_ptr_and_size(void* ptr, isize size){
-	return ((uintptr(ptr) & (mem_page_size - 1)) == 0) && ((size & (mem_page_size - 1)) == 0);
+	isize page_size = virtual_page_size();
+	return ((uintptr(ptr) & (page_size - 1)) == 0) && ((size & (page_size - 1)) == 0);
 }
 
-void* virtual_reserve(isize nbytes){
-	nbytes = mem_align_forward_size(nbytes, mem_page_size);
+static
+isize query_page_size(){
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return isize(info.dwPageSize);
+}
+
+isize virtual_page_size(){
+	static const isize page_size = query_page_size();
+	return page_size;
+}
+
+isize virtual_huge_page_size(){
+	static const isize huge_page_size = isize(GetLargePageMinimum());
+	return huge_page_size;
+}
+
+isize virtual_explicit_huge_page_size(){
+	return 0;
+}
+
+// Large pages on Windows must be committed up front with MEM_LARGE_PAGES and
+// need SeLockMemoryPrivilege, which doesn't fit reserve then commit. So
+// mem_page_huge only affects granularity and mem_page_huge_explicit fails.
+void* virtual_reserve(isize nbytes, u32 flags){
+	if(flags & mem_page_huge_explicit){ return nullptr; }
+	nbytes = mem_align_forward_size(nbytes, virtual_page_size());
 	return VirtualAlloc(nullptr, nbytes, MEM_RESERVE, PAGE_NOACCESS);
 }
 
@@ -19,9 +45,16 @@ void virtual_release(void* pointer, isize nbytes){
 	VirtualFree(pointer, nbytes, MEM_RELEASE);
 }
 
-void* virtual_commit(void* pointer, isize nbytes){
+void* virtual_commit(void* pointer, isize nbytes, u32 flags){
 	debug_assert(valid_ptr_and_size(pointer, nbytes), "Pointer and allocation size must be page aligned");
 	void* p = VirtualAlloc(pointer, nbytes, MEM_COMMIT, PAGE_READWRITE);
+	if(p != nullptr && (flags & mem_page_prefault)){
+		isize page_size = virtual_page_size();
+		volatile u8* bytes = (volatile u8*)p;
+		for(isize i = 0; i < nbytes; i += page_size){
+			bytes[i] = bytes[i];
+		}
+	}
 	return p;
 }
 